@@ -1,190 +1,4831 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cfloat>
+#include <charconv>
+#include <condition_variable>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define GAUSS_HAVE_URING
+#endif
 #include <tbb/tbb.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#if defined(__F16C__) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
 #include "tbb/task_scheduler_init.h"
 #include "tbb/tick_count.h"
 using namespace std;
 using namespace tbb;
 
 /**
- * matrix_t represents a 2-d (square) array of doubles
+ * singular_matrix_t is what a solver throws when it meets a zero pivot, so
+ * that the caller decides what a singular system means: main() stops, and
+ * the differential test counts a failure and goes on
  */
-class matrix_t {
+struct singular_matrix_t : std::runtime_error {
+  singular_matrix_t() : std::runtime_error("The matrix is singular!") {}
+};
+
+/**
+ * basic_matrix_t represents a 2-d (square) array of T.  Most of the code
+ * works on matrix_t, an array of doubles; the mixed-precision solvers also
+ * keep factors in narrower types.
+ */
+template <typename T> class basic_matrix_t {
   /**
    * M is the matrix.  It is an array of arrays, so that we can swap row
    * pointers in O(1) instead of swapping rows in O(n)
    */
-  double **M;
+  T **M;
+
+  /** the # rows / # columns / sqrt(# elements) */
+  unsigned int size;
+
+  /**
+   * the distance between the starts of consecutive rows of data, in
+   * elements.  It is at least size, and padded so rows don't alias
+   */
+  unsigned int ld;
+
+  /** one cache-aligned block holding every row, ld elements apart */
+  T *data;
+
+public:
+  /**
+   * Pick the leading dimension for rows of n elements: a whole number of
+   * cache lines, and an odd one.  With a power-of-two row length (n=2048
+   * makes every row exactly 16 KiB), a column walk such as A[k][i] would
+   * otherwise hit the same few cache sets on every row, and alias at 4K
+   */
+  static unsigned int paddedStride(unsigned int n) {
+    const unsigned int line = 64 / sizeof(T);
+    unsigned int ld = (n + line - 1) / line * line;
+    if ((ld / line) % 2 == 0)
+      ld += line;
+    return ld;
+  }
+
+  /**
+   * Construct by allocating the matrix, with the given leading dimension or
+   * (if 0) an automatically padded one
+   */
+  basic_matrix_t(unsigned int n, unsigned int stride = 0)
+      : M(new T *[n]), size(n),
+        ld(stride >= n ? stride : paddedStride(n)),
+        data(tbb::cache_aligned_allocator<T>().allocate(
+            std::max<std::size_t>(1, (std::size_t)n * ld))) {
+    for (unsigned int i = 0; i < size; ++i)
+      M[i] = data + (std::size_t)i * ld;
+  }
+  /** Deep copy, so that a system can be solved more than once */
+  basic_matrix_t(const basic_matrix_t &other)
+      : basic_matrix_t(other.size, other.ld) {
+    for (unsigned int i = 0; i < size; ++i)
+      std::copy(other.M[i], other.M[i] + size, M[i]);
+  }
+  basic_matrix_t &operator=(const basic_matrix_t &) = delete;
+  /** Release the rows and the row pointers */
+  ~basic_matrix_t() {
+    tbb::cache_aligned_allocator<T>().deallocate(
+        data, std::max<std::size_t>(1, (std::size_t)size * ld));
+    delete[] M;
+  }
+  /** Give the illusion of this being a simple array */
+  T *&operator[](std::size_t idx) { return M[idx]; };
+  T *const &operator[](std::size_t idx) const { return M[idx]; };
+  unsigned int getSize() const { return size; }
+  unsigned int getStride() const { return ld; }
+};
+
+/** matrix_t represents a 2-d (square) array of doubles */
+typedef basic_matrix_t<double> matrix_t;
+
+/**
+ * vector_t represents a 1-d array of doubles
+ */
+class vector_t {
+  /** simple array of doubles */
+  double *V;
+
+  /** size of V */
+  unsigned int size;
+
+public:
+  /** Construct by allocating the vector */
+  vector_t(unsigned int n) : size(n), V(new double[n]) {}
+  /** Deep copy, so that a right-hand side can be reused */
+  vector_t(const vector_t &other) : vector_t(other.size) {
+    std::copy(other.V, other.V + size, V);
+  }
+  vector_t &operator=(const vector_t &) = delete;
+  /** Release the array */
+  ~vector_t() { delete[] V; }
+  /** Give the illusion of this being a simple array */
+  double &operator[](std::size_t idx) { return V[idx]; };
+  const double &operator[](std::size_t idx) const { return V[idx]; };
+  unsigned int getSize() const { return size; }
+};
+
+/**
+ * tiled_matrix_t stores a square matrix of doubles as square tiles of edge
+ * 2^shift.  Each tile is contiguous, row-major inside, and the tiles follow
+ * a Z-order (Morton) curve, so any aligned block of 2^k x 2^k tiles is
+ * contiguous too, and a recursive or tiled algorithm keeps its working set
+ * together at every level of the memory hierarchy.  The matrix is padded
+ * to whole tiles with the identity.
+ *
+ * Rows are no longer contiguous, so swapping two rows is O(n), one tile
+ * column at a time.  Indexing stays cheap: at() is two shifts, two masks
+ * and a load from the table of tile offsets, and operator[] gives a row
+ * that indexes through it, so A[i][j] works as it does for matrix_t.
+ */
+class tiled_matrix_t {
+  /** the order, padded to whole tiles; tiles per side; log2 of the edge */
+  unsigned int size, tiles, shift;
+
+  /** where each tile starts, by tile row and column */
+  std::vector<std::size_t> offset;
+
+  /** all the tiles */
+  double *data;
+
+  /** Spread the bits of x apart, to interleave them with another's */
+  static uint64_t spread(uint64_t x) {
+    x &= 0xffffffff;
+    x = (x | x << 16) & 0x0000ffff0000ffffULL;
+    x = (x | x << 8) & 0x00ff00ff00ff00ffULL;
+    x = (x | x << 4) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | x << 2) & 0x3333333333333333ULL;
+    x = (x | x << 1) & 0x5555555555555555ULL;
+    return x;
+  }
+
+public:
+  /**
+   * Construct a copy of A in tiles of edge 2^shift.  Each tile is filled
+   * by the task that allocates its pages first, so tiles are placed on the
+   * memory of the core that first uses them, independently of each other.
+   */
+  tiled_matrix_t(const matrix_t &A, unsigned int shift)
+      : size(0), tiles(0), shift(shift) {
+    unsigned int n = A.getSize(), edge = 1u << shift;
+    tiles = (n + edge - 1) >> shift;
+    size = tiles << shift;
+    std::vector<std::pair<uint64_t, unsigned int>> curve;
+    for (unsigned int I = 0; I < tiles; ++I)
+      for (unsigned int J = 0; J < tiles; ++J)
+        curve.emplace_back(spread(I) << 1 | spread(J), I * tiles + J);
+    std::sort(curve.begin(), curve.end());
+    offset.resize(curve.size());
+    for (std::size_t k = 0; k < curve.size(); ++k)
+      offset[curve[k].second] = k << (2 * shift);
+    data = tbb::cache_aligned_allocator<double>().allocate(
+        std::max<std::size_t>(1, (std::size_t)size * size));
+    parallel_for(blocked_range<unsigned int>(0, tiles * tiles),
+                 [&](const blocked_range<unsigned int> &r) {
+                   for (unsigned int t = r.begin(); t != r.end(); ++t) {
+                     unsigned int I = t / tiles, J = t % tiles;
+                     double *d = tile(I, J);
+                     for (unsigned int a = 0; a < edge; ++a)
+                       for (unsigned int b = 0; b < edge; ++b) {
+                         unsigned int i = I << shift | a, j = J << shift | b;
+                         d[a << shift | b] =
+                             i < n && j < n ? A[i][j] : i == j ? 1 : 0;
+                       }
+                   }
+                 });
+  }
+  tiled_matrix_t(const tiled_matrix_t &) = delete;
+  tiled_matrix_t &operator=(const tiled_matrix_t &) = delete;
+  /** Release the tiles */
+  ~tiled_matrix_t() {
+    tbb::cache_aligned_allocator<double>().deallocate(
+        data, std::max<std::size_t>(1, (std::size_t)size * size));
+  }
+
+  /** The tile at tile row I and tile column J */
+  double *tile(unsigned int I, unsigned int J) {
+    return data + offset[I * tiles + J];
+  }
+
+  /** The part of row i that lies in tile column J */
+  double *rowOf(unsigned int i, unsigned int J) {
+    return tile(i >> shift, J) + ((std::size_t)(i & (getEdge() - 1)) << shift);
+  }
+
+  /** The element at row i, column j */
+  double &at(unsigned int i, unsigned int j) {
+    unsigned int mask = getEdge() - 1;
+    return tile(i >> shift, j >> shift)[(i & mask) << shift | (j & mask)];
+  }
+
+  /** row_t is a row of the matrix, indexed through at() */
+  struct row_t {
+    tiled_matrix_t &A;
+    unsigned int i;
+    double &operator[](std::size_t j) const { return A.at(i, j); }
+  };
+  row_t operator[](std::size_t i) { return row_t{*this, (unsigned int)i}; }
+
+  unsigned int getSize() const { return size; }
+  unsigned int getTiles() const { return tiles; }
+  unsigned int getEdge() const { return 1u << shift; }
+};
+
+/**
+ * Make row i of the system that seed names: the n elements of row i of A,
+ * then B[i], as random numbers in the range (-range...range).  Every row
+ * has a generator of its own, seeded from (seed, i), so any row can be made
+ * again on its own, in any order and on any thread.
+ */
+template <typename T>
+void generateRow(int seed, std::size_t i, std::size_t n, unsigned int range,
+                 T *a, double &b) {
+  // splitmix64 spreads (seed, i) over the whole 64-bit seed
+  uint64_t z = ((uint64_t)(uint32_t)seed << 32) +
+               (i + 1) * 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  std::mt19937_64 gen(z ^ (z >> 31));
+  std::uniform_real_distribution<double> dist(-(double)range, range);
+  for (std::size_t j = 0; j < n; ++j)
+    a[j] = (T)dist(gen);
+  b = dist(gen);
+}
+
+/**
+ * Given a random seed, populate the rows of A and B, in parallel, with
+ * random numbers in the range (-range...range), as generateRow() makes them
+ */
+template <typename T>
+void initializeFromSeed(int seed, basic_matrix_t<T> &A, vector_t &B,
+                        unsigned int range) {
+  parallel_for(blocked_range<std::size_t>(0, A.getSize()),
+               [&](const blocked_range<std::size_t> &r) {
+                 for (std::size_t i = r.begin(); i != r.end(); ++i)
+                   generateRow(seed, i, A.getSize(), range, A[i], B[i]);
+               });
+}
+
+/**
+ * row_visitor_t is given part of a row of the system [A | B]: the count
+ * values of row i from column j on, where column n is B[i].  It may be
+ * called from many threads at once, but never for the same row at once.
+ */
+typedef std::function<void(std::size_t i, std::size_t j, const double *v,
+                           std::size_t count)>
+    row_visitor_t;
+
+/** row_source_t passes every row of a system to a visitor, in any order */
+typedef std::function<void(const row_visitor_t &)> row_source_t;
+
+/**
+ * The rows of the system that seed names, made on the fly, in parallel,
+ * each into a buffer of its task that is reused for the next row
+ */
+row_source_t seedRows(int seed, std::size_t n, unsigned int range) {
+  return [=](const row_visitor_t &visit) {
+    parallel_for(blocked_range<std::size_t>(0, n),
+                 [&](const blocked_range<std::size_t> &r) {
+                   std::vector<double> row(n + 1);
+                   for (std::size_t i = r.begin(); i != r.end(); ++i) {
+                     generateRow(seed, i, n, range, row.data(), row[n]);
+                     visit(i, 0, row.data(), n + 1);
+                   }
+                 });
+  };
+}
+
+/** What verifyRows() found */
+struct verification_t {
+  /** ||b - Ax|| / (||A|| ||x|| + ||b||), in the infinity norm */
+  double backwardError = 0;
+
+  /** the row with the largest residual, its (A * x)_i and its b_i */
+  std::size_t worst = 0;
+  double ans = 0, b = 0;
+};
+
+/**
+ * Measure how well X solves A * x = b (or A^T * x = b, with transpose set)
+ * for the system that source makes, without ever holding A: each row is
+ * used as it arrives and then dropped, so only O(n) more memory is needed.
+ */
+verification_t verifyRows(const row_source_t &source, std::size_t n,
+                          const vector_t &X, bool transpose = false) {
+  // A * x (or A^T * x), the absolute row (or column) sums of A, and b
+  std::vector<double> ans(n), sum(n), b(n);
+  if (!transpose) {
+    source([&](std::size_t i, std::size_t j, const double *v,
+               std::size_t count) {
+      double s = 0, a = 0;
+      for (std::size_t k = 0; k < count; ++k)
+        if (j + k < n) {
+          s += v[k] * X[j + k];
+          a += abs(v[k]);
+        } else {
+          b[i] = v[k];
+        }
+      ans[i] += s;
+      sum[i] += a;
+    });
+  } else {
+    // row i adds to every column, so each thread keeps sums of its own
+    tbb::enumerable_thread_specific<std::vector<double>> partial(
+        std::vector<double>(2 * n));
+    source([&](std::size_t i, std::size_t j, const double *v,
+               std::size_t count) {
+      std::vector<double> &p = partial.local();
+      for (std::size_t k = 0; k < count; ++k)
+        if (j + k < n) {
+          p[j + k] += v[k] * X[i];
+          p[n + j + k] += abs(v[k]);
+        } else {
+          b[i] = v[k];
+        }
+    });
+    for (auto &p : partial)
+      for (std::size_t c = 0; c < n; ++c) {
+        ans[c] += p[c];
+        sum[c] += p[n + c];
+      }
+  }
+  verification_t v;
+  double rnorm = 0, anorm = 0, xnorm = 0, bnorm = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (abs(b[i] - ans[i]) > rnorm) {
+      rnorm = abs(b[i] - ans[i]);
+      v.worst = i;
+    }
+    anorm = std::max(anorm, sum[i]);
+    xnorm = std::max(xnorm, abs(X[i]));
+    bnorm = std::max(bnorm, abs(b[i]));
+  }
+  // an empty system, or b = 0 solved by x = 0, is solved exactly
+  double scale = anorm * xnorm + bnorm;
+  v.backwardError = scale > 0 ? rnorm / scale : rnorm > 0 ? INFINITY : 0;
+  v.ans = n ? ans[v.worst] : 0;
+  v.b = n ? b[v.worst] : 0;
+  return v;
+}
+
+/** How print() and printSolution() render numbers */
+struct output_t {
+  /** significant digits of each number in text mode */
+  int precision = 6;
+
+  /** write raw doubles (see binary_header_t) instead of text */
+  bool binary = false;
+};
+
+/**
+ * binary_header_t starts every binary dump: a magic string, then the shape
+ * of the row-major array of doubles that follows
+ */
+struct binary_header_t {
+  char magic[8] = {'G', 'A', 'U', 'S', 'S', 'M', 'A', 'T'};
+  uint32_t rows = 0;
+  uint32_t cols = 0;
+};
+
+/** Write all of buf to fd, retrying after short writes */
+void writeAll(int fd, const char *buf, std::size_t len) {
+  while (len > 0) {
+    ssize_t w = write(fd, buf, len);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      exit(-1);
+    }
+    buf += w;
+    len -= w;
+  }
+}
+
+/** Append v to out as text with the given number of significant digits */
+void appendNumber(std::string &out, double v, int precision) {
+  char buf[64];
+  auto r = std::to_chars(buf, buf + sizeof(buf), v,
+                         std::chars_format::general, precision);
+  out.append(buf, r.ptr);
+}
+
+/**
+ * Produce a large dump in parallel: items [0, count) are rendered by
+ * format(i, out) into one buffer per block of items, and each buffer goes
+ * out with a single write().  Only a window of blocks is in memory at once,
+ * and blocks are always written in order.
+ */
+void writeBlocks(int fd, int count, int itemsPerBlock,
+                 const std::function<void(int, std::string &)> &format) {
+  std::cout.flush();
+  fflush(stdout);
+  int blocks = (count + itemsPerBlock - 1) / itemsPerBlock;
+  int window = 4 * tbb::this_task_arena::max_concurrency();
+  std::vector<std::string> bufs(window);
+  for (int first = 0; first < blocks; first += window) {
+    int last = std::min(blocks, first + window);
+    parallel_for(first, last, [&](int b) {
+      std::string &out = bufs[b - first];
+      out.clear();
+      for (int i = b * itemsPerBlock;
+           i < std::min(count, (b + 1) * itemsPerBlock); ++i)
+        format(i, out);
+    });
+    for (int b = first; b < last; ++b)
+      writeAll(fd, bufs[b - first].data(), bufs[b - first].size());
+  }
+}
+
+/** Write the header of a binary dump of a rows x cols array */
+void writeBinaryHeader(int fd, uint32_t rows, uint32_t cols) {
+  binary_header_t h;
+  h.rows = rows;
+  h.cols = cols;
+  std::cout.flush();
+  fflush(stdout);
+  writeAll(fd, (const char *)&h, sizeof(h));
+}
+
+/**
+ * Print the matrix and array in a form that looks good, or as one binary
+ * n x (n+1) array with B as the last column
+ */
+void print(matrix_t &A, vector_t &B, const output_t &fmt = output_t()) {
+  int n = A.getSize();
+  // aim for blocks of about a megabyte of text
+  int rowsPerBlock = std::max(1, (1 << 20) / (16 * (n + 1)));
+  if (fmt.binary) {
+    writeBinaryHeader(1, n, n + 1);
+    writeBlocks(1, n, rowsPerBlock, [&](int i, std::string &out) {
+      out.append((const char *)A[i], n * sizeof(double));
+      out.append((const char *)&B[i], sizeof(double));
+    });
+    return;
+  }
+  writeBlocks(1, n, rowsPerBlock, [&](int i, std::string &out) {
+    for (int j = 0; j < n; ++j) {
+      appendNumber(out, A[i][j], fmt.precision);
+      out += '\t';
+    }
+    out += " | ";
+    appendNumber(out, B[i], fmt.precision);
+    out += '\n';
+  });
+  std::cout << std::endl;
+}
+
+/** Print the solution on one line, or as a binary n x 1 array */
+void printSolution(vector_t &X, const output_t &fmt = output_t()) {
+  const int chunk = 4096;
+  int n = X.getSize();
+  int chunks = (n + chunk - 1) / chunk;
+  if (fmt.binary) {
+    writeBinaryHeader(1, n, 1);
+    writeBlocks(1, chunks, 16, [&](int c, std::string &out) {
+      int len = std::min(n, (c + 1) * chunk) - c * chunk;
+      out.append((const char *)&X[c * chunk], len * sizeof(double));
+    });
+    return;
+  }
+  writeBlocks(1, chunks, 16, [&](int c, std::string &out) {
+    for (int i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i) {
+      appendNumber(out, X[i], fmt.precision);
+      out += ' ';
+    }
+  });
+  std::cout << std::endl << std::endl;
+}
+
+/**
+ * async_io_t keeps up to depth large reads and writes in flight at once, on
+ * any number of files, so that I/O overlaps with parsing and compute.  It
+ * uses io_uring when the kernel has it (through the raw system calls), and
+ * otherwise a pool of depth threads doing pread() and pwrite().  Requests
+ * carry a tag, and complete() returns the tag and result of a finished one,
+ * in whatever order they finish.
+ *
+ * Buffers, offsets and lengths should be multiples of ioAlign, so that
+ * files opened with openDirect() can bypass the page cache.
+ */
+class async_io_t {
+  /** the most requests in flight, and how many are */
+  unsigned int depth, inflight = 0;
+
+  /** a request, as the thread pool queues it */
+  struct request_t {
+    int fd;
+    bool write;
+    void *buf;
+    std::size_t len;
+    off_t offset;
+    uint64_t tag;
+  };
+
+#ifdef GAUSS_HAVE_URING
+  /** the ring, or -1 without io_uring, and its shared memory */
+  int ring = -1;
+  unsigned *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+  io_uring_sqe *sqes;
+  io_uring_cqe *cqes;
+  void *sqMap = MAP_FAILED, *cqMap = MAP_FAILED, *sqeMap = MAP_FAILED;
+  std::size_t sqLen = 0, cqLen = 0, sqeLen = 0;
+
+  /** Set up a ring of depth entries; false if the kernel can't */
+  bool setupRing() {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof p);
+    ring = syscall(__NR_io_uring_setup, depth, &p);
+    if (ring < 0)
+      return false;
+    // plain reads and writes need 5.6, which is also when this appeared
+    if (!(p.features & IORING_FEAT_RW_CUR_POS))
+      return false;
+    sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqLen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      sqLen = cqLen = std::max(sqLen, cqLen);
+    sqMap = mmap(nullptr, sqLen, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (sqMap == MAP_FAILED)
+      return false;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      cqMap = sqMap;
+    else
+      cqMap = mmap(nullptr, cqLen, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    sqeLen = p.sq_entries * sizeof(io_uring_sqe);
+    sqeMap = mmap(nullptr, sqeLen, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (cqMap == MAP_FAILED || sqeMap == MAP_FAILED)
+      return false;
+    char *sq = (char *)sqMap, *cq = (char *)cqMap;
+    sqTail = (unsigned *)(sq + p.sq_off.tail);
+    sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sqArray = (unsigned *)(sq + p.sq_off.array);
+    cqHead = (unsigned *)(cq + p.cq_off.head);
+    cqTail = (unsigned *)(cq + p.cq_off.tail);
+    cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    sqes = (io_uring_sqe *)sqeMap;
+    return true;
+  }
+
+  /** Unmap and close whatever setupRing() made */
+  void closeRing() {
+    if (sqeMap != MAP_FAILED)
+      munmap(sqeMap, sqeLen);
+    if (cqMap != MAP_FAILED && cqMap != sqMap)
+      munmap(cqMap, cqLen);
+    if (sqMap != MAP_FAILED)
+      munmap(sqMap, sqLen);
+    if (ring >= 0)
+      close(ring);
+    ring = -1;
+  }
+#endif
+
+  /** the thread pool, its queue of requests, and the finished ones */
+  std::vector<std::thread> pool;
+  std::mutex m;
+  std::condition_variable queued, finished;
+  std::deque<request_t> pending;
+  std::deque<std::pair<uint64_t, ssize_t>> done;
+  bool stopping = false;
+
+  /** Serve requests until told to stop */
+  void serve() {
+    for (;;) {
+      std::unique_lock<std::mutex> lock(m);
+      queued.wait(lock, [&] { return stopping || !pending.empty(); });
+      if (pending.empty())
+        return;
+      request_t r = pending.front();
+      pending.pop_front();
+      lock.unlock();
+      // finish the whole request, as io_uring would, unless it fails
+      std::size_t total = 0;
+      ssize_t got = 0;
+      while (total < r.len) {
+        got = r.write ? pwrite(r.fd, (char *)r.buf + total, r.len - total,
+                               r.offset + total)
+                      : pread(r.fd, (char *)r.buf + total, r.len - total,
+                              r.offset + total);
+        if (got < 0 && errno == EINTR)
+          continue;
+        if (got <= 0)
+          break;
+        total += got;
+      }
+      lock.lock();
+      done.emplace_back(r.tag, got < 0 ? -errno : (ssize_t)total);
+      finished.notify_one();
+    }
+  }
+
+public:
+  /** Start an engine with up to depth requests in flight */
+  explicit async_io_t(unsigned int depth = 8) : depth(depth) {
+#ifdef GAUSS_HAVE_URING
+    if (setupRing())
+      return;
+    closeRing();
+#endif
+    for (unsigned int t = 0; t < depth; ++t)
+      pool.emplace_back([this] { serve(); });
+  }
+  async_io_t(const async_io_t &) = delete;
+  async_io_t &operator=(const async_io_t &) = delete;
+  /** Wait for the pool, and release the ring */
+  ~async_io_t() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      stopping = true;
+    }
+    queued.notify_all();
+    for (auto &t : pool)
+      t.join();
+#ifdef GAUSS_HAVE_URING
+    closeRing();
+#endif
+  }
+
+  /** Is io_uring doing the work? */
+  bool usingRing() const { return pool.empty(); }
+
+  /** the most requests in flight */
+  unsigned int getDepth() const { return depth; }
+
+  /**
+   * Start reading (or writing) len bytes of fd at offset into (or from)
+   * buf.  The caller keeps no more than depth requests in flight.
+   */
+  void submit(int fd, bool write, void *buf, std::size_t len, off_t offset,
+              uint64_t tag) {
+#ifdef GAUSS_HAVE_URING
+    if (ring >= 0) {
+      unsigned tail = *sqTail, idx = tail & *sqMask;
+      io_uring_sqe *sqe = &sqes[idx];
+      std::memset(sqe, 0, sizeof *sqe);
+      sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->addr = (uint64_t)(uintptr_t)buf;
+      sqe->len = len;
+      sqe->off = offset;
+      sqe->user_data = tag;
+      sqArray[idx] = idx;
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+      while (syscall(__NR_io_uring_enter, ring, 1, 0, 0, nullptr, 0) < 0)
+        if (errno != EINTR && errno != EAGAIN) {
+          perror("io_uring_enter");
+          exit(-1);
+        }
+      ++inflight;
+      return;
+    }
+#endif
+    std::lock_guard<std::mutex> lock(m);
+    pending.push_back(request_t{fd, write, buf, len, offset, tag});
+    ++inflight;
+    queued.notify_one();
+  }
+
+  /** Are there requests in flight? */
+  bool busy() const { return inflight > 0; }
+
+  /**
+   * Wait for a request to finish, and return its tag and its result: the
+   * bytes done, or -errno
+   */
+  std::pair<uint64_t, ssize_t> complete() {
+    --inflight;
+#ifdef GAUSS_HAVE_URING
+    if (ring >= 0) {
+      for (;;) {
+        unsigned head = *cqHead;
+        if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+          io_uring_cqe *cqe = &cqes[head & *cqMask];
+          std::pair<uint64_t, ssize_t> r(cqe->user_data, cqe->res);
+          __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+          return r;
+        }
+        if (syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS,
+                    nullptr, 0) < 0 &&
+            errno != EINTR) {
+          perror("io_uring_enter");
+          exit(-1);
+        }
+      }
+    }
+#endif
+    std::unique_lock<std::mutex> lock(m);
+    finished.wait(lock, [&] { return !done.empty(); });
+    std::pair<uint64_t, ssize_t> r = done.front();
+    done.pop_front();
+    return r;
+  }
+};
+
+/** The alignment of direct I/O: buffers, offsets and lengths */
+const std::size_t ioAlign = 4096;
+
+/** The size of each request of the loaders and writers */
+const std::size_t ioChunk = 4 << 20;
+
+/** The engine that loading and writing share */
+async_io_t &asyncIO() {
+  static async_io_t engine;
+  return engine;
+}
+
+/**
+ * Open path with O_DIRECT, so large transfers skip the page cache, or
+ * without it where the file system doesn't allow it
+ */
+int openDirect(const char *path, int flags, mode_t mode = 0644) {
+  int fd = open(path, flags | O_DIRECT, mode);
+  if (fd < 0 && errno == EINVAL)
+    fd = open(path, flags, mode);
+  if (fd < 0) {
+    perror(path);
+    exit(-1);
+  }
+  return fd;
+}
+
+/** A buffer of len bytes for direct I/O, rounded up to whole blocks */
+std::unique_ptr<char, void (*)(void *)> ioBuffer(std::size_t len) {
+  void *p = nullptr;
+  len = (len + ioAlign - 1) / ioAlign * ioAlign;
+  if (posix_memalign(&p, ioAlign, std::max(len, ioAlign)) != 0) {
+    std::cout << "Out of memory for an I/O buffer" << std::endl;
+    exit(-1);
+  }
+  return std::unique_ptr<char, void (*)(void *)>((char *)p, free);
+}
+
+/** The magic string of a compressed system, in place of GAUSSMAT */
+const char compressedMagic[8] = {'G', 'A', 'U', 'S', 'S', 'L', 'Z', '2'};
+
+/**
+ * Read the header of a binary system, as writeSystem(), print() or
+ * writeCompressed() writes it
+ */
+binary_header_t readBinaryHeader(const char *path) {
+  int fd = openDirect(path, O_RDONLY);
+  auto buf = ioBuffer(ioAlign);
+  ssize_t got = pread(fd, buf.get(), ioAlign, 0);
+  close(fd);
+  binary_header_t h, want;
+  if (got >= (ssize_t)sizeof h)
+    std::memcpy(&h, buf.get(), sizeof h);
+  if (got < (ssize_t)sizeof h ||
+      (std::memcmp(h.magic, want.magic, sizeof h.magic) != 0 &&
+       std::memcmp(h.magic, compressedMagic, sizeof h.magic) != 0) ||
+      h.cols != h.rows + 1) {
+    std::cout << path << ": not a binary n x (n+1) system" << std::endl;
+    exit(-1);
+  }
+  return h;
+}
+
+/**
+ * compressed_header_t follows the binary_header_t of a compressed system.
+ * The n x (n+1) array is cut into chunks of rowsPerChunk rows, each
+ * filtered and compressed on its own, and a table of (offset, bytes, CRC-32
+ * of the uncompressed doubles) for every chunk follows this header, so
+ * chunks can be decoded, and checked, in parallel.
+ */
+struct compressed_header_t {
+  /** rows in every chunk but the last */
+  uint32_t rowsPerChunk = 0;
+
+  /** mantissa bits kept of each double: 52 is lossless */
+  uint32_t mantissa = 52;
+
+  /** the number of chunks */
+  uint32_t chunks = 0;
+
+  uint32_t reserved = 0;
+};
+
+/** Read a little-endian 32-bit word */
+uint32_t load32(const uint8_t *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+/** The CRC-32 (as zlib computes it) of len bytes */
+uint32_t crc32(const uint8_t *p, std::size_t len) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t b = 0; b < 256; ++b) {
+      uint32_t c = b;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[b] = c;
+    }
+    return t;
+  }();
+  uint32_t c = 0xFFFFFFFFu;
+  for (std::size_t k = 0; k < len; ++k)
+    c = table[(c ^ p[k]) & 0xff] ^ (c >> 8);
+  return c ^ 0xFFFFFFFFu;
+}
+
+/** Append a length in LZ style: 255s, then the remainder */
+void appendLength(std::string &out, std::size_t len) {
+  for (; len >= 255; len -= 255)
+    out += (char)255;
+  out += (char)len;
+}
+
+/**
+ * Compress len bytes with a small LZ77 codec in the style of LZ4: each
+ * sequence is a token (literal length, match length - 4, a nibble each,
+ * with longer lengths spilled into following bytes), the literals, and a
+ * 16-bit backward offset of the match.  The last sequence has literals
+ * only.  Matches are found through a hash of the next four bytes.
+ */
+void lzCompress(const uint8_t *in, std::size_t len, std::string &out) {
+  const int bits = 14;
+  std::vector<uint32_t> table(1 << bits, 0);
+  std::size_t anchor = 0, i = 0;
+  auto sequence = [&](std::size_t literals, std::size_t offset,
+                      std::size_t match) {
+    std::size_t m = match ? match - 4 : 0;
+    out += (char)(std::min<std::size_t>(literals, 15) << 4 |
+                  std::min<std::size_t>(m, 15));
+    if (literals >= 15)
+      appendLength(out, literals - 15);
+    out.append((const char *)in + anchor, literals);
+    if (!match)
+      return;
+    out += (char)(offset & 0xff);
+    out += (char)(offset >> 8);
+    if (m >= 15)
+      appendLength(out, m - 15);
+  };
+  while (i + 4 <= len) {
+    uint32_t word = load32(in + i);
+    uint32_t &slot = table[(word * 2654435761u) >> (32 - bits)];
+    std::size_t cand = slot;
+    slot = i + 1;
+    if (cand && i + 1 - cand <= 65535 && load32(in + cand - 1) == word) {
+      std::size_t from = cand - 1, match = 4;
+      while (i + match < len && in[from + match] == in[i + match])
+        ++match;
+      sequence(i - anchor, i - from, match);
+      i += match;
+      anchor = i;
+    } else {
+      ++i;
+    }
+  }
+  sequence(len - anchor, 0, 0);
+}
+
+/** Undo lzCompress() into exactly len bytes; false if the input is bad */
+bool lzDecompress(const uint8_t *in, std::size_t inLen, uint8_t *out,
+                  std::size_t len) {
+  std::size_t ip = 0, op = 0;
+  auto length = [&](std::size_t &n) {
+    uint8_t b;
+    do {
+      if (ip >= inLen)
+        return false;
+      b = in[ip++];
+      n += b;
+    } while (b == 255);
+    return true;
+  };
+  while (ip < inLen) {
+    uint8_t token = in[ip++];
+    std::size_t literals = token >> 4, match = token & 15;
+    if (literals == 15 && !length(literals))
+      return false;
+    if (literals > inLen - ip || literals > len - op)
+      return false;
+    std::memcpy(out + op, in + ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip >= inLen)
+      break;
+    if (inLen - ip < 2)
+      return false;
+    std::size_t offset = in[ip] | in[ip + 1] << 8;
+    ip += 2;
+    if (match == 15 && !length(match))
+      return false;
+    match += 4;
+    if (offset == 0 || offset > op || match > len - op)
+      return false;
+    // byte by byte, since a match may overlap what it produces
+    for (std::size_t k = 0; k < match; ++k, ++op)
+      out[op] = out[op - offset];
+  }
+  return op == len;
+}
+
+/**
+ * Filter count doubles for compression: round away all but mantissa bits
+ * of each, XOR each with the one before it (neighbours share their sign,
+ * exponent and high mantissa bits, which then become zeros), and shuffle
+ * the bytes so that byte b of every word is together: the zeros line up
+ * into long runs for the codec.
+ */
+void filterDoubles(const double *v, std::size_t count, int mantissa,
+                   uint8_t *out) {
+  uint64_t prev = 0;
+  int drop = 52 - mantissa;
+  for (std::size_t k = 0; k < count; ++k) {
+    uint64_t x;
+    std::memcpy(&x, &v[k], sizeof x);
+    if (drop > 0)
+      x = (x + (1ULL << (drop - 1))) & ~((1ULL << drop) - 1);
+    uint64_t d = x ^ prev;
+    prev = x;
+    for (int b = 0; b < 8; ++b)
+      out[b * count + k] = (uint8_t)(d >> (8 * b));
+  }
+}
+
+/** Undo filterDoubles(), but for the rounding */
+void unfilterDoubles(const uint8_t *in, std::size_t count, double *v) {
+  uint64_t prev = 0;
+  for (std::size_t k = 0; k < count; ++k) {
+    uint64_t d = 0;
+    for (int b = 0; b < 8; ++b)
+      d |= (uint64_t)in[b * count + k] << (8 * b);
+    prev ^= d;
+    std::memcpy(&v[k], &prev, sizeof prev);
+  }
+}
+
+/**
+ * Write A and B to path as a compressed system, keeping mantissa bits of
+ * each value.  Chunks are filtered and compressed in parallel.  Returns the
+ * bytes written.
+ */
+std::size_t writeCompressed(const char *path, matrix_t &A, vector_t &B,
+                            int mantissa) {
+  std::size_t n = A.getSize(), w = n + 1;
+  binary_header_t h;
+  std::memcpy(h.magic, compressedMagic, sizeof h.magic);
+  h.rows = n;
+  h.cols = w;
+  compressed_header_t c;
+  c.rowsPerChunk = std::max<std::size_t>(1, (1 << 17) / w);
+  c.mantissa = mantissa;
+  c.chunks = (n + c.rowsPerChunk - 1) / c.rowsPerChunk;
+
+  std::vector<std::string> payload(c.chunks);
+  std::vector<uint32_t> crc(c.chunks);
+  parallel_for(blocked_range<uint32_t>(0, c.chunks, 1),
+               [&](const blocked_range<uint32_t> &r) {
+                 std::vector<double> raw;
+                 std::vector<uint8_t> filtered;
+                 for (uint32_t k = r.begin(); k != r.end(); ++k) {
+                   std::size_t r0 = (std::size_t)k * c.rowsPerChunk,
+                               r1 = std::min(n, r0 + c.rowsPerChunk);
+                   raw.resize((r1 - r0) * w);
+                   for (std::size_t i = r0; i < r1; ++i) {
+                     std::copy(A[i], A[i] + n, &raw[(i - r0) * w]);
+                     raw[(i - r0) * w + n] = B[i];
+                   }
+                   filtered.resize(raw.size() * sizeof(double));
+                   filterDoubles(raw.data(), raw.size(), mantissa,
+                                 filtered.data());
+                   lzCompress(filtered.data(), filtered.size(), payload[k]);
+                   // of the values as they will be read back, rounded
+                   unfilterDoubles(filtered.data(), raw.size(), raw.data());
+                   crc[k] = crc32((const uint8_t *)raw.data(),
+                                  raw.size() * sizeof(double));
+                 }
+               });
+
+  std::vector<uint64_t> table(3 * c.chunks);
+  uint64_t offset = sizeof h + sizeof c + table.size() * sizeof(uint64_t);
+  for (uint32_t k = 0; k < c.chunks; ++k) {
+    table[3 * k] = offset;
+    table[3 * k + 1] = payload[k].size();
+    table[3 * k + 2] = crc[k];
+    offset += payload[k].size();
+  }
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    exit(-1);
+  }
+  writeAll(fd, (const char *)&h, sizeof h);
+  writeAll(fd, (const char *)&c, sizeof c);
+  writeAll(fd, (const char *)table.data(), table.size() * sizeof(uint64_t));
+  for (auto &p : payload)
+    writeAll(fd, p.data(), p.size());
+  close(fd);
+  return offset;
+}
+
+/**
+ * Stream a compressed system to visit.  Its chunks are read through the
+ * engine in batches of about ioChunk bytes, and the chunks of each batch are
+ * decompressed in parallel, a row at a time to visit, while the next batch
+ * is being read.  Only two batches are held at once, however large the
+ * system.  A chunk whose CRC doesn't match is never visited, and fails the
+ * load.
+ */
+void streamCompressed(const char *path, std::size_t n,
+                      const row_visitor_t &visit) {
+  std::size_t w = n + 1;
+  int fd = openDirect(path, O_RDONLY);
+  off_t end = lseek(fd, 0, SEEK_END);
+  if (end < 0) {
+    perror(path);
+    exit(-1);
+  }
+  std::size_t bytes = end;
+  async_io_t &io = asyncIO();
+
+  // span_t is a read of [from, to) of the file, whose bytes are at data
+  struct span_t {
+    std::unique_ptr<char, void (*)(void *)> buf;
+    const uint8_t *data;
+    std::size_t from, to;
+  };
+  auto start = [&](std::size_t from, std::size_t to) {
+    std::size_t lo = from / ioAlign * ioAlign;
+    std::size_t len = (to - lo + ioAlign - 1) / ioAlign * ioAlign;
+    span_t s{ioBuffer(len), nullptr, from, to};
+    s.data = (const uint8_t *)s.buf.get() + (from - lo);
+    io.submit(fd, false, s.buf.get(), len, lo, 0);
+    return s;
+  };
+  auto finish = [&](const span_t &s) {
+    if (io.complete().second < (ssize_t)(s.to - s.from / ioAlign * ioAlign)) {
+      std::cout << path << ": short read" << std::endl;
+      exit(-1);
+    }
+  };
+
+  // the headers, then the table of chunks
+  binary_header_t h;
+  compressed_header_t c;
+  bool ok = bytes >= sizeof h + sizeof c;
+  std::vector<uint64_t> table;
+  if (ok) {
+    span_t s = start(0, sizeof h + sizeof c);
+    finish(s);
+    std::memcpy(&h, s.data, sizeof h);
+    std::memcpy(&c, s.data + sizeof h, sizeof c);
+    ok = h.rows == n && c.rowsPerChunk > 0 &&
+         c.chunks == (n + c.rowsPerChunk - 1) / c.rowsPerChunk &&
+         bytes >= sizeof h + sizeof c + 3 * c.chunks * sizeof(uint64_t);
+  }
+  if (ok) {
+    table.resize(3 * c.chunks);
+    std::size_t from = sizeof h + sizeof c;
+    span_t s = start(from, from + table.size() * sizeof(uint64_t));
+    finish(s);
+    std::memcpy(table.data(), s.data, table.size() * sizeof(uint64_t));
+  }
+  for (uint32_t k = 0; ok && k < c.chunks; ++k)
+    ok = table[3 * k] <= bytes && table[3 * k + 1] <= bytes - table[3 * k];
+
+  // Batch up the chunks from first on, to about ioChunk bytes, and start
+  // reading them; last is set past the batch
+  auto batch = [&](uint32_t first, uint32_t &last) {
+    std::size_t from = table[3 * first], to = from + table[3 * first + 1];
+    for (last = first + 1; last < c.chunks; ++last) {
+      std::size_t f = std::min<std::size_t>(from, table[3 * last]),
+                  t = std::max<std::size_t>(
+                      to, table[3 * last] + table[3 * last + 1]);
+      if (t - f > ioChunk)
+        break;
+      from = f;
+      to = t;
+    }
+    return start(from, to);
+  };
+  std::atomic<bool> intact(ok);
+  uint32_t first = 0, last = 0;
+  std::unique_ptr<span_t> next;
+  if (ok && c.chunks > 0)
+    next.reset(new span_t(batch(first, last)));
+  while (next) {
+    finish(*next);
+    span_t current = std::move(*next);
+    next.reset();
+    uint32_t k0 = first, k1 = last;
+    if (last < c.chunks) {
+      first = last;
+      next.reset(new span_t(batch(first, last)));
+    }
+    parallel_for(
+        blocked_range<uint32_t>(k0, k1, 1),
+        [&](const blocked_range<uint32_t> &r) {
+          std::vector<uint8_t> filtered;
+          std::vector<double> raw;
+          for (uint32_t k = r.begin(); k != r.end(); ++k) {
+            std::size_t r0 = (std::size_t)k * c.rowsPerChunk,
+                        r1 = std::min(n, r0 + c.rowsPerChunk);
+            raw.resize((r1 - r0) * w);
+            filtered.resize(raw.size() * sizeof(double));
+            if (!lzDecompress(current.data + (table[3 * k] - current.from),
+                              table[3 * k + 1], filtered.data(),
+                              filtered.size())) {
+              intact = false;
+              continue;
+            }
+            unfilterDoubles(filtered.data(), raw.size(), raw.data());
+            // no row of a damaged chunk is passed on
+            if (crc32((const uint8_t *)raw.data(),
+                      raw.size() * sizeof(double)) != table[3 * k + 2]) {
+              intact = false;
+              continue;
+            }
+            for (std::size_t i = r0; i < r1; ++i)
+              visit(i, 0, &raw[(i - r0) * w], w);
+          }
+        });
+    if (!intact)
+      break;
+  }
+  close(fd);
+  if (!intact) {
+    std::cout << path << ": corrupt compressed system" << std::endl;
+    exit(-1);
+  }
+}
+
+/**
+ * Stream the system in path, an n x (n+1) binary dump with B as the last
+ * column (or a compressed one), to visit.  The file is read in large
+ * aligned chunks with up to the engine's depth in flight, and each chunk
+ * is passed on a row at a time, in parallel, while the next ones are still
+ * being read.
+ */
+void streamSystem(const char *path, std::size_t n,
+                  const row_visitor_t &visit) {
+  std::size_t header = sizeof(binary_header_t);
+  std::size_t bytes = header + n * (n + 1) * sizeof(double);
+  binary_header_t h = readBinaryHeader(path);
+  if (h.rows != n) {
+    std::cout << path << ": not a system of size " << n << std::endl;
+    exit(-1);
+  }
+  if (std::memcmp(h.magic, compressedMagic, sizeof h.magic) == 0) {
+    streamCompressed(path, n, visit);
+    return;
+  }
+  async_io_t &io = asyncIO();
+  int fd = openDirect(path, O_RDONLY);
+  std::size_t chunks = (bytes + ioChunk - 1) / ioChunk;
+  std::vector<std::unique_ptr<char, void (*)(void *)>> bufs;
+  for (unsigned int k = 0; k < std::min<std::size_t>(io.getDepth(), chunks); ++k)
+    bufs.push_back(ioBuffer(ioChunk));
+
+  std::size_t next = 0;
+  auto issue = [&](std::size_t slot) {
+    io.submit(fd, false, bufs[slot].get(), ioChunk, next * ioChunk,
+              next << 8 | slot);
+    ++next;
+  };
+  for (std::size_t slot = 0; slot < bufs.size(); ++slot)
+    issue(slot);
+  while (io.busy()) {
+    auto r = io.complete();
+    std::size_t chunk = r.first >> 8, slot = r.first & 0xff;
+    std::size_t from = chunk * ioChunk, to = std::min(bytes, from + ioChunk);
+    if (r.second < (ssize_t)(to - from)) {
+      std::cout << path << ": short read" << std::endl;
+      exit(-1);
+    }
+    // The elements of this chunk, which starts and ends on a double (as
+    // the header and the chunks are multiples of one, so is each element's
+    // place in the buffer)
+    std::size_t e0 = (std::max(from, header) - header) / sizeof(double);
+    std::size_t e1 = (to - header) / sizeof(double);
+    const double *base = (const double *)(bufs[slot].get() + header - from);
+    if (e0 < e1)
+      parallel_for(blocked_range<std::size_t>(e0 / (n + 1), (e1 - 1) / (n + 1) + 1),
+                   [&](const blocked_range<std::size_t> &rows) {
+                     for (std::size_t i = rows.begin(); i != rows.end(); ++i) {
+                       std::size_t b = std::max(e0, i * (n + 1)),
+                                   e = std::min(e1, (i + 1) * (n + 1));
+                       visit(i, b - i * (n + 1), base + b, e - b);
+                     }
+                   });
+    if (next < chunks)
+      issue(slot);
+  }
+  close(fd);
+}
+
+/** Load the system in path (see streamSystem()) into A and B */
+void loadSystem(const char *path, matrix_t &A, vector_t &B) {
+  std::size_t n = A.getSize();
+  streamSystem(path, n, [&](std::size_t i, std::size_t j, const double *v,
+                            std::size_t count) {
+    for (std::size_t k = 0; k < count; ++k)
+      if (j + k < n)
+        A[i][j + k] = v[k];
+      else
+        B[i] = v[k];
+  });
+}
+
+/** The rows of the system in path, read again (see streamSystem()) */
+row_source_t fileRows(const std::string &path, std::size_t n) {
+  return [=](const row_visitor_t &visit) {
+    streamSystem(path.c_str(), n, visit);
+  };
+}
+
+/**
+ * Write a binary rows x cols array to path, in large aligned chunks: each
+ * chunk is filled while the ones before it are being written.  run(k, count)
+ * gives element k of the array, in row-major order, and sets count to how
+ * many elements from it on are contiguous in memory.
+ */
+void writeBinary(
+    const char *path, std::size_t rows, std::size_t cols,
+    const std::function<const double *(std::size_t, std::size_t &)> &run) {
+  std::size_t n = rows * cols, header = sizeof(binary_header_t);
+  std::size_t bytes = header + n * sizeof(double);
+  async_io_t &io = asyncIO();
+  int fd = openDirect(path, O_WRONLY | O_CREAT | O_TRUNC);
+  std::size_t chunks = (bytes + ioChunk - 1) / ioChunk;
+  std::vector<std::unique_ptr<char, void (*)(void *)>> bufs;
+  for (unsigned int k = 0; k < std::min<std::size_t>(io.getDepth(), chunks); ++k)
+    bufs.push_back(ioBuffer(ioChunk));
+  binary_header_t h;
+  h.rows = rows;
+  h.cols = cols;
+
+  std::size_t spare = bufs.size();
+  std::vector<std::size_t> idle(spare);
+  for (std::size_t k = 0; k < spare; ++k)
+    idle[k] = k;
+  auto reap = [&] {
+    auto r = io.complete();
+    if (r.second < 0) {
+      std::cout << path << ": " << strerror(-r.second) << std::endl;
+      exit(-1);
+    }
+    idle[spare++] = r.first & 0xff;
+  };
+  for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+    if (spare == 0)
+      reap();
+    std::size_t slot = idle[--spare];
+    char *buf = bufs[slot].get();
+    std::size_t from = chunk * ioChunk, to = std::min(bytes, from + ioChunk);
+    // direct I/O writes whole blocks; the file is cut to size at the end
+    std::size_t len = (to - from + ioAlign - 1) / ioAlign * ioAlign;
+    std::memset(buf + (to - from), 0, len - (to - from));
+    for (std::size_t o = from; o < to;) {
+      if (o < header) {
+        std::memcpy(buf, (const char *)&h, header);
+        o = header;
+        continue;
+      }
+      std::size_t k = (o - header) / sizeof(double), count;
+      const double *v = run(k, count);
+      count = std::min(count, (to - o) / sizeof(double));
+      std::memcpy(buf + (o - from), v, count * sizeof(double));
+      o += count * sizeof(double);
+    }
+    io.submit(fd, true, buf, len, from, chunk << 8 | slot);
+  }
+  while (io.busy())
+    reap();
+  if (ftruncate(fd, bytes) != 0) {
+    perror(path);
+    exit(-1);
+  }
+  close(fd);
+}
+
+/** Write X to path as a binary n x 1 array */
+void writeSolution(const char *path, vector_t &X) {
+  std::size_t n = X.getSize();
+  writeBinary(path, n, 1, [&](std::size_t k, std::size_t &count) {
+    count = n - k;
+    return &X[k];
+  });
+}
+
+/**
+ * Write A and B to path as one binary n x (n+1) array with B as the last
+ * column, which loadSystem() reads back
+ */
+void writeSystem(const char *path, matrix_t &A, vector_t &B) {
+  std::size_t n = A.getSize();
+  writeBinary(path, n, n + 1, [&](std::size_t k, std::size_t &count) {
+    std::size_t i = k / (n + 1), j = k % (n + 1);
+    count = j < n ? n - j : 1;
+    return j < n ? &A[i][j] : &B[i];
+  });
+}
+
+/**
+ * cache_info_t describes the data caches of the CPU we are running on, as
+ * seen by one core
+ */
+struct cache_info_t {
+  /** sizes of the L1 data, L2 and L3 caches, in bytes */
+  long l1 = 32 << 10, l2 = 1 << 20, l3 = 8 << 20;
+
+  /** how many logical CPUs share the L3 */
+  int l3share = 1;
+
+  /** where the numbers came from: "sysfs", "cpuid" or "default" */
+  const char *source = "default";
+};
+
+/** Parse a sysfs cache size such as "48K" or "32M" */
+long parseCacheSize(const std::string &s) {
+  long v = atol(s.c_str());
+  if (s.find('K') != std::string::npos)
+    v <<= 10;
+  else if (s.find('M') != std::string::npos)
+    v <<= 20;
+  return v;
+}
+
+/** Count the CPUs in a sysfs cpu list such as "0-3,8-11" */
+int countCpuList(const std::string &s) {
+  int count = 0;
+  std::size_t pos = 0;
+  while (pos < s.size()) {
+    std::size_t end = s.find(',', pos);
+    if (end == std::string::npos)
+      end = s.size();
+    std::string item = s.substr(pos, end - pos);
+    std::size_t dash = item.find('-');
+    count += dash == std::string::npos
+                 ? 1
+                 : atoi(item.c_str() + dash + 1) - atoi(item.c_str()) + 1;
+    pos = end + 1;
+  }
+  return std::max(1, count);
+}
+
+/**
+ * Find the cache hierarchy from /sys/devices/system/cpu/cpu0/cache, falling
+ * back to CPUID leaf 4 on x86, and to conservative defaults otherwise
+ */
+cache_info_t probeCaches() {
+  cache_info_t info;
+  bool found = false;
+  for (int idx = 0;; ++idx) {
+    std::string dir =
+        "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(idx) + "/";
+    std::ifstream level(dir + "level"), type(dir + "type"), size(dir + "size"),
+        shared(dir + "shared_cpu_list");
+    int lv;
+    std::string ty, sz, cpus;
+    if (!(level >> lv) || !(type >> ty) || !(size >> sz))
+      break;
+    if (ty == "Instruction")
+      continue;
+    found = true;
+    if (lv == 1)
+      info.l1 = parseCacheSize(sz);
+    else if (lv == 2)
+      info.l2 = parseCacheSize(sz);
+    else if (lv == 3) {
+      info.l3 = parseCacheSize(sz);
+      if (shared >> cpus)
+        info.l3share = countCpuList(cpus);
+    }
+  }
+  if (found) {
+    info.source = "sysfs";
+    return info;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned eax, ebx, ecx, edx;
+  for (unsigned sub = 0; __get_cpuid_count(4, sub, &eax, &ebx, &ecx, &edx);
+       ++sub) {
+    unsigned type = eax & 0x1f, lv = (eax >> 5) & 0x7;
+    if (type == 0)
+      break;
+    if (type == 2)
+      continue;
+    long bytes = (long)((ebx >> 22) + 1) * (((ebx >> 12) & 0x3ff) + 1) *
+                 ((ebx & 0xfff) + 1) * (ecx + 1);
+    found = true;
+    if (lv == 1)
+      info.l1 = bytes;
+    else if (lv == 2)
+      info.l2 = bytes;
+    else if (lv == 3) {
+      info.l3 = bytes;
+      info.l3share = ((eax >> 14) & 0xfff) + 1;
+    }
+  }
+  if (found)
+    info.source = "cpuid";
+#endif
+  return info;
+}
+
+/**
+ * tiling_t holds the block sizes of the factorization and triangular-solve
+ * kernels, derived from the cache hierarchy
+ */
+struct tiling_t {
+  /** edge of a square tile of doubles that fits in half of L1 */
+  int micro;
+
+  /** doubles in a row segment that a task keeps in L1 while streaming */
+  int strip;
+
+  /** bytes of rows each task of a sweep should own: half of L2 */
+  long panel;
+
+  /** edge of the diagonal blocks of the triangular solves: an L3 share */
+  int tile;
+
+  /** the caches the sizes were derived from */
+  cache_info_t caches;
+
+  /** Rows per task for a sweep over rows of len doubles */
+  int rows(int len) const {
+    return (int)std::max(1L, panel / (long)(sizeof(double) * std::max(1, len)));
+  }
+};
+
+/** Round the square root of x down to a multiple of 8, but no less than 8 */
+int squareEdge(double x) { return std::max(8, (int)std::sqrt(x) / 8 * 8); }
+
+/** Derive the block sizes for the given caches */
+tiling_t deriveTiling(const cache_info_t &caches) {
+  tiling_t t;
+  t.caches = caches;
+  t.micro = squareEdge(caches.l1 / 2.0 / sizeof(double));
+  t.strip = std::max(64L, caches.l1 / 2 / (long)sizeof(double));
+  t.panel = caches.l2 / 2;
+  t.tile = std::min(
+      1024, squareEdge(caches.l3 / caches.l3share / 4.0 / sizeof(double)));
+  return t;
+}
+
+/** The block sizes every kernel uses; probed once, and overridable */
+tiling_t &tiling() {
+  static tiling_t t = deriveTiling(probeCaches());
+  return t;
+}
+
+/** pivot_t is a candidate pivot: a row, and the magnitude of its entry */
+struct pivot_t {
+  int row;
+  double big;
+};
+
+/**
+ * Combine two candidate pivots.  The larger magnitude wins, and ties go to
+ * the lower row, so the choice doesn't depend on how the work was split.
+ */
+pivot_t betterPivot(const pivot_t &a, const pivot_t &b) {
+  if (b.big > a.big || (b.big == a.big && b.row < a.row))
+    return b;
+  return a;
+}
+
+/** Find the largest entry of column i on or below the diagonal */
+pivot_t findPivot(matrix_t &A, int i) {
+  return parallel_reduce(
+      blocked_range<int>(i, int(A.getSize()), tiling().rows(A.getSize() - i)),
+      pivot_t{i, -1.0},
+      [&](const blocked_range<int> &r, pivot_t best) {
+        for (int k = r.begin(); k != r.end(); ++k)
+          best = betterPivot(best, pivot_t{k, abs(A[k][i])});
+        return best;
+      },
+      betterPivot);
+}
+
+/**
+ * growth_monitor_t watches the pivot growth factor while a matrix is being
+ * eliminated: the largest magnitude seen in the trailing matrix, relative
+ * to the largest in the original.  Large growth is what makes Gaussian
+ * elimination unstable, so this flags trouble as it happens instead of
+ * after an expensive check of the answer.
+ */
+struct growth_monitor_t {
+  /** should the solvers that support it report to this monitor? */
+  bool enabled = false;
+
+  /** the growth factor at which the hook fires */
+  double threshold = 1e4;
+
+  /** called once per factorization, with the step and the growth */
+  std::function<void(int, double)> hook;
+
+  /** the largest magnitude in the original matrix, and so far */
+  double initial = 0, largest = 0;
+
+  /** has the hook fired for this factorization? */
+  bool fired = false;
+
+  /** The growth factor so far */
+  double growth() const { return initial > 0 ? largest / initial : 1; }
+
+  /** Begin a factorization of a matrix whose largest magnitude is big */
+  void start(double big) {
+    initial = largest = big;
+    fired = false;
+  }
+
+  /** Record the largest magnitude that step produced */
+  void update(int step, double big) {
+    largest = std::max(largest, big);
+    if (!fired && growth() > threshold) {
+      fired = true;
+      if (hook)
+        hook(step, growth());
+    }
+  }
+};
+
+/** The monitor that main() configures for the solvers in the table */
+growth_monitor_t &growthMonitor() {
+  static growth_monitor_t monitor;
+  return monitor;
+}
+
+/** The largest magnitude in A */
+double maxAbs(const matrix_t &A) {
+  int n = A.getSize();
+  return parallel_reduce(
+      blocked_range<int>(0, n, tiling().rows(n)), 0.0,
+      [&](const blocked_range<int> &r, double big) {
+        for (int i = r.begin(); i != r.end(); ++i)
+          for (int j = 0; j < n; ++j)
+            big = std::max(big, abs(A[i][j]));
+        return big;
+      },
+      [](double a, double b) { return std::max(a, b); });
+}
+
+/**
+ * sweep_t is what an elimination sweep reduces to: the next pivot, and the
+ * largest magnitude it wrote (if anyone is watching the growth)
+ */
+struct sweep_t {
+  pivot_t pivot;
+  double big;
+};
+
+/** Combine the results of two parts of a sweep */
+sweep_t combineSweeps(const sweep_t &a, const sweep_t &b) {
+  return sweep_t{betterPivot(a.pivot, b.pivot), std::max(a.big, b.big)};
+}
+
+/**
+ * Factor A in place into L * U with the right-looking Gaussian Elimination
+ * technique and partial pivoting.  Each step stores its multipliers where
+ * it creates zeros, so L (with a unit diagonal that isn't stored) ends up
+ * below the diagonal and U on and above it.  piv[i] is the row that was
+ * swapped with row i at step i; the swaps are only recorded here, and are
+ * applied to right-hand sides later, all at once, by luSolve().
+ *
+ * If a monitor is given, each sweep also reduces the largest magnitude it
+ * writes, and reports it to the monitor.  With from > 0, the first from
+ * steps are taken as done (as gaussRefactor() leaves them), and only the
+ * rest of piv is written.
+ */
+void gaussFactor(matrix_t &A, std::vector<int> &piv,
+                 growth_monitor_t *monitor = nullptr, int from = 0) {
+  int n = A.getSize();
+  piv.resize(n);
+  if (monitor)
+    monitor->start(maxAbs(A));
+
+  // For numerical stability, each step uses the largest value in its column
+  // as the pivot.  Only the first column is searched on its own: every
+  // elimination sweep finds the pivot of the next column as a by-product
+  pivot_t pivot = findPivot(A, from);
+
+  // iterate over rows
+  for (int i = from; i < n; ++i) {
+    // NB: we are now on the ith column
+
+    // Given our random initialization, singular matrices are possible!
+    if (pivot.big == 0.0)
+      throw singular_matrix_t();
+
+    // swap so max column value is in ith row.  Rows are pointers, so this
+    // is O(1) for all of A, including the multipliers left of column i
+    piv[i] = pivot.row;
+    std::swap(A[i], A[pivot.row]);
+
+    // Eliminate the ith row from all subsequent rows
+    //
+    // NB: this will lead to all subsequent rows having a 0 in the ith
+    // column, which is where the multiplier goes.  Column i+1 of each row
+    // is final as soon as that row is done, so each task reduces it to a
+    // local pivot while it is still in cache
+    sweep_t sweep = parallel_reduce(
+        blocked_range<int>(i + 1, n, tiling().rows(n - i)),
+        sweep_t{pivot_t{i + 1, -1.0}, 0.0},
+        [&](const blocked_range<int> &r, sweep_t best) {
+          for (int k = r.begin(); k != r.end(); ++k) {
+            double c = A[k][i] / A[i][i];
+            A[k][i] = c;
+            if (monitor)
+              for (int j = i + 1; j < n; ++j) {
+                A[k][j] -= c * A[i][j];
+                best.big = std::max(best.big, abs(A[k][j]));
+              }
+            else
+              for (int j = i + 1; j < n; ++j)
+                A[k][j] -= c * A[i][j];
+            best.pivot = betterPivot(best.pivot, pivot_t{k, abs(A[k][i + 1])});
+          }
+          return best;
+        },
+        combineSweeps);
+    pivot = sweep.pivot;
+    if (monitor)
+      monitor->update(i, sweep.big);
+  }
+}
+
+/**
+ * Do step j of the left-looking (Crout) factorization of A: compute column
+ * j of L and row j of U from the factors already finished, and touch
+ * nothing right of column j below row j.  With pivoting, the largest
+ * candidate in column j becomes the pivot; without it, row j is used as it
+ * is and column j isn't searched at all.  ucol is scratch space of at least
+ * j elements.
+ *
+ * Returns the pivot (with its magnitude), and the largest magnitude in the
+ * new row of U.  If the pivot is zero, the step stops before using it.
+ */
+template <typename T>
+sweep_t croutStep(basic_matrix_t<T> &A, int j, bool pivoting,
+                  std::vector<int> &piv, std::vector<T> &ucol) {
+  int n = A.getSize();
+  // Gather column j of U, so every dot product below reads contiguously
+  for (int k = 0; k < j; ++k)
+    ucol[k] = A[k][j];
+
+  // Column j, on and below the diagonal, is each row of L dotted with that
+  // column.  With pivoting, find the pivot while the results are at hand;
+  // without it, the diagonal is the pivot and there is nothing to search
+  auto column = [&](int i) {
+    T *l = A[i];
+    T s = l[j];
+    for (int k = 0; k < j; ++k)
+      s -= l[k] * ucol[k];
+    return l[j] = s;
+  };
+  blocked_range<int> below(j, n, tiling().rows(j + 1));
+  pivot_t pivot{j, -1.0};
+  if (pivoting) {
+    pivot = parallel_reduce(
+        below, pivot,
+        [&](const blocked_range<int> &r, pivot_t best) {
+          for (int i = r.begin(); i != r.end(); ++i)
+            best = betterPivot(best, pivot_t{i, abs(column(i))});
+          return best;
+        },
+        betterPivot);
+  } else {
+    parallel_for(below, [&](const blocked_range<int> &r) {
+      for (int i = r.begin(); i != r.end(); ++i)
+        column(i);
+    });
+    pivot.big = abs(A[j][j]);
+  }
+  if (pivot.big == 0.0)
+    return sweep_t{pivot, 0.0};
+  piv[j] = pivot.row;
+  std::swap(A[j], A[pivot.row]);
+
+  // Row j of U, right of the diagonal, subtracts the rows of U above it,
+  // weighted by row j of L.  Only row j is written
+  T *row = A[j];
+  double big = parallel_reduce(
+      blocked_range<int>(j + 1, n, tiling().strip), pivot.big,
+      [&](const blocked_range<int> &r, double most) {
+        for (int k = 0; k < j; ++k) {
+          const T l = row[k], *u = A[k];
+          for (int c = r.begin(); c != r.end(); ++c)
+            row[c] -= l * u[c];
+        }
+        for (int c = r.begin(); c != r.end(); ++c)
+          most = std::max(most, (double)abs(row[c]));
+        return most;
+      },
+      [](double a, double b) { return std::max(a, b); });
+
+  // Scale column j of L by the pivot
+  T d = row[j];
+  parallel_for(blocked_range<int>(j + 1, n, tiling().rows(j + 1)),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i)
+                   A[i][j] /= d;
+               });
+  return sweep_t{pivot, big};
+}
+
+/**
+ * Factor A in place into L * U, with partial pivoting, in the left-looking
+ * (Crout) order: step j computes column j of L and row j of U from the
+ * factors already finished, and never touches anything right of column j
+ * below row j.  That is O(n^2) writes in total instead of the O(n^3) of
+ * gauss(), which rewrites the whole trailing matrix at every step.
+ *
+ * L has a unit diagonal, which isn't stored.  piv[j] is the row that was
+ * swapped with row j at step j.
+ */
+void crout(matrix_t &A, std::vector<int> &piv) {
+  int n = A.getSize();
+  piv.resize(n);
+  std::vector<double> ucol(n);
+  for (int j = 0; j < n; ++j)
+    if (croutStep(A, j, true, piv, ucol).pivot.big == 0.0)
+      throw singular_matrix_t();
+}
+
+/**
+ * Fold the row interchanges recorded in piv (as by gaussFactor()) into the
+ * single permutation they make: row i ends up holding row perm[i]
+ */
+std::vector<int> foldInterchanges(const std::vector<int> &piv) {
+  int n = piv.size();
+  std::vector<int> perm(n);
+  for (int i = 0; i < n; ++i)
+    perm[i] = i;
+  for (int i = 0; i < n; ++i)
+    std::swap(perm[i], perm[piv[i]]);
+  return perm;
+}
+
+/** The inverse of foldInterchanges(): a sequence of interchanges for perm */
+std::vector<int> interchangesOf(const std::vector<int> &perm) {
+  int n = perm.size();
+  std::vector<int> cur(n), pos(n), piv(n);
+  for (int i = 0; i < n; ++i)
+    cur[i] = pos[i] = i;
+  for (int i = 0; i < n; ++i) {
+    int p = pos[perm[i]];
+    piv[i] = p;
+    std::swap(cur[i], cur[p]);
+    pos[cur[i]] = i;
+    pos[cur[p]] = p;
+  }
+  return piv;
+}
+
+/**
+ * Apply the row interchanges recorded in piv (as by gaussFactor()) to B, or
+ * with inverse set, undo them.  Rather than n dependent swaps, the whole
+ * sequence is first folded into a single permutation, which is then
+ * gathered (or scattered) in parallel.
+ */
+void applyInterchanges(const std::vector<int> &piv, vector_t &B,
+                       bool inverse = false) {
+  int n = piv.size();
+  std::vector<int> perm = foldInterchanges(piv);
+  vector_t T(B);
+  parallel_for(blocked_range<int>(0, n, tiling().strip),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i)
+                   if (inverse)
+                     B[perm[i]] = T[i];
+                   else
+                     B[i] = T[perm[i]];
+               });
+}
+
+/**
+ * Solve A * x = b, given the factors and the pivots that crout() or
+ * gaussFactor() left in A.
+ * B is permuted in place.
+ */
+template <typename T>
+void luSolve(basic_matrix_t<T> &A, const std::vector<int> &piv, vector_t &B,
+             vector_t &X) {
+  int n = A.getSize();
+  // Apply the row interchanges in one batch
+  applyInterchanges(piv, B);
+
+  // Forward substitution with L, which has a unit diagonal, a block of rows
+  // at a time: first every row of the block subtracts the part of X that is
+  // already known, in parallel, then the diagonal block is solved serially
+  int nb = tiling().tile;
+  for (int b = 0; b < n; b += nb) {
+    int e = std::min(n, b + nb);
+    parallel_for(blocked_range<int>(b, e, tiling().rows(b + 1)),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     double s = B[i];
+                     for (int k = 0; k < b; ++k)
+                       s -= A[i][k] * X[k];
+                     X[i] = s;
+                   }
+                 });
+    for (int i = b; i < e; ++i)
+      for (int k = b; k < i; ++k)
+        X[i] -= A[i][k] * X[k];
+  }
+
+  // Back substitution with U, in the same blocked way from the bottom up
+  for (int e = n; e > 0; e -= nb) {
+    int b = std::max(0, e - nb);
+    parallel_for(blocked_range<int>(b, e, tiling().rows(n - e + 1)),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     double s = X[i];
+                     for (int k = e; k < n; ++k)
+                       s -= A[i][k] * X[k];
+                     X[i] = s;
+                   }
+                 });
+    for (int i = e - 1; i >= b; --i) {
+      for (int k = i + 1; k < e; ++k)
+        X[i] -= A[i][k] * X[k];
+      X[i] /= A[i][i];
+    }
+  }
+}
+
+/**
+ * Solve A^T * y = c, reusing the factors and pivots of A that crout() or
+ * gaussFactor() left in A, in O(n^2).  Since P * A = L * U, we have
+ * A^T = U^T * L^T * P, so we solve with U^T, then with L^T, then undo P.
+ *
+ * The transposed factors are columns of the row-major ones, so both solves
+ * are done column-oriented: once an unknown is known, its row of the factor
+ * is subtracted from the rest of the right-hand side.  Each diagonal block
+ * is solved serially, then the update of the remaining right-hand side is
+ * split over column ranges, so every task reads contiguous row segments.
+ * C is overwritten.
+ */
+void luSolveTranspose(matrix_t &A, const std::vector<int> &piv, vector_t &C,
+                      vector_t &Y) {
+  int n = A.getSize(), nb = tiling().tile;
+
+  // U^T is lower triangular: go forward
+  for (int b = 0; b < n; b += nb) {
+    int e = std::min(n, b + nb);
+    for (int k = b; k < e; ++k) {
+      C[k] /= A[k][k];
+      for (int j = k + 1; j < e; ++j)
+        C[j] -= C[k] * A[k][j];
+    }
+    parallel_for(blocked_range<int>(e, std::max(e, n), tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int k = b; k < e; ++k) {
+                     const double z = C[k], *u = A[k];
+                     for (int j = r.begin(); j != r.end(); ++j)
+                       C[j] -= z * u[j];
+                   }
+                 });
+  }
+
+  // L^T is upper triangular with a unit diagonal: go backward
+  for (int e = n; e > 0; e -= nb) {
+    int b = std::max(0, e - nb);
+    for (int k = e - 1; k >= b; --k)
+      for (int j = b; j < k; ++j)
+        C[j] -= C[k] * A[k][j];
+    parallel_for(blocked_range<int>(0, b, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int k = b; k < e; ++k) {
+                     const double w = C[k], *l = A[k];
+                     for (int j = r.begin(); j != r.end(); ++j)
+                       C[j] -= w * l[j];
+                   }
+                 });
+  }
+
+  // Finally undo the row interchanges
+  applyInterchanges(piv, C, true);
+  for (int i = 0; i < n; ++i)
+    Y[i] = C[i];
+}
+
+/**
+ * Solve A * x = b like gauss(), and keep what more solves need: the factors
+ * stay in A, and the interchanges in piv
+ */
+void gaussKeepingPivots(matrix_t &A, vector_t &B, vector_t &X,
+                        std::vector<int> &piv) {
+  gaussFactor(A, piv,
+              growthMonitor().enabled ? &growthMonitor() : nullptr);
+  luSolve(A, piv, B, X);
+}
+
+/**
+ * For a system of equations A * x = b, with Matrix A and Vectors B and X,
+ * and assuming we only know A and b, compute x via the Gaussian Elimination
+ * technique
+ */
+void gauss(matrix_t &A, vector_t &B, vector_t &X) {
+  std::vector<int> piv;
+  gaussKeepingPivots(A, B, X, piv);
+}
+
+/**
+ * Solve A^T * x = b (not A * x = b) with the factors of A, as an adjoint
+ * solve does.  This is the way luSolveTranspose() goes through the
+ * differential test.
+ */
+void transposeSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  std::vector<int> piv;
+  gaussFactor(A, piv);
+  luSolveTranspose(A, piv, B, X);
+}
+
+/**
+ * Solve A * x = b with the left-looking factorization, keeping the factors
+ * in A and the interchanges in piv
+ */
+void croutKeepingPivots(matrix_t &A, vector_t &B, vector_t &X,
+                        std::vector<int> &piv) {
+  crout(A, piv);
+  luSolve(A, piv, B, X);
+}
+
+/** Solve A * x = b with the left-looking factorization */
+void croutSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  std::vector<int> piv;
+  croutKeepingPivots(A, B, X, piv);
+}
+
+/**
+ * Factor A in place like gaussFactor(), but with the pivot sequence piv of
+ * an earlier factorization instead of searching for one.  All the
+ * interchanges are applied upfront, as one parallel permutation of the row
+ * pointers, and then no step does an argmax reduction: each sweep is a
+ * plain parallel_for.
+ *
+ * A reused pivot is trusted while its magnitude is at least tol times the
+ * largest in A.  At the first step where it isn't, the factorization goes
+ * on from that step with partial pivoting, and piv is rewritten to the
+ * interchanges that were actually made.  Returns that step, or -1 if every
+ * pivot was reused.
+ */
+int gaussRefactor(matrix_t &A, std::vector<int> &piv, double tol) {
+  int n = A.getSize();
+  std::vector<int> perm = foldInterchanges(piv);
+  std::vector<double *> rows(n);
+  parallel_for(blocked_range<int>(0, n, tiling().strip),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i)
+                   rows[i] = A[perm[i]];
+               });
+  parallel_for(blocked_range<int>(0, n, tiling().strip),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i)
+                   A[i] = rows[i];
+               });
+
+  double small = tol * maxAbs(A);
+  for (int i = 0; i < n; ++i) {
+    if (abs(A[i][i]) <= small) {
+      // Pivot from here on.  The rows are already in the order of perm, so
+      // the new interchanges come after it
+      std::vector<int> rest(n);
+      for (int k = 0; k < i; ++k)
+        rest[k] = k;
+      gaussFactor(A, rest, nullptr, i);
+      std::vector<int> after = foldInterchanges(rest), total(n);
+      for (int k = 0; k < n; ++k)
+        total[k] = perm[after[k]];
+      piv = interchangesOf(total);
+      return i;
+    }
+    double d = A[i][i];
+    parallel_for(blocked_range<int>(i + 1, n, tiling().rows(n - i)),
+                 [&](const blocked_range<int> &r) {
+                   const double *u = A[i];
+                   for (int k = r.begin(); k != r.end(); ++k) {
+                     double *row = A[k], c = row[i] / d;
+                     row[i] = c;
+                     for (int j = i + 1; j < n; ++j)
+                       row[j] -= c * u[j];
+                   }
+                 });
+  }
+  return -1;
+}
+
+/**
+ * pivot_record_t is the pivot sequence that staticSolve() reuses, and what
+ * happened the last time it was used
+ */
+struct pivot_record_t {
+  /** the interchanges of the latest factorization, empty before the first */
+  std::vector<int> piv;
+
+  /** the smallest reused pivot to trust, relative to the largest entry */
+  double tol = std::sqrt(DBL_EPSILON);
+
+  /** did the latest solve reuse the sequence? */
+  bool reused = false;
+
+  /** the step from which it had to pivot again, or -1 if it didn't */
+  int pivotFrom = -1;
+};
+
+/** The pivot sequence shared by every staticSolve() */
+pivot_record_t &pivotRecord() {
+  static pivot_record_t record;
+  return record;
+}
+
+/**
+ * Solve A * x = b reusing the pivot sequence of the previous solve of the
+ * same size, for a sequence of matrices whose values drift slowly.  The
+ * first solve (or one of a new size) pivots as gauss() does, and records
+ * its sequence; later ones refactor with gaussRefactor().
+ */
+void staticSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  pivot_record_t &record = pivotRecord();
+  record.reused = record.piv.size() == A.getSize();
+  record.pivotFrom = -1;
+  if (record.reused)
+    record.pivotFrom = gaussRefactor(A, record.piv, record.tol);
+  else
+    gaussFactor(A, record.piv);
+  luSolve(A, record.piv, B, X);
+}
+
+/**
+ * escalation_t records what adaptiveSolve() (or halfSolve()) had to do, for
+ * reporting
+ */
+struct escalation_t {
+  /** has either run since this was reset? */
+  bool used = false;
+
+  /** the first column factored with pivoting, or -1 if none was */
+  int pivotFrom = -1;
+
+  /** did it have to refactor in double precision? */
+  bool doublePrecision = false;
+
+  /** iterative refinement steps taken */
+  int refinements = 0;
+
+  /**
+   * the normwise backward error of the refined answer, or -1 after the
+   * refactorization in double, which overwrites A before it can be measured
+   */
+  double backwardError = -1;
+
+  /** the type the fast factors were kept in */
+  const char *storage = "float";
+};
+
+/** The record of the latest adaptiveSolve() or halfSolve() */
+escalation_t &escalationReport() {
+  static escalation_t report;
+  return report;
+}
+
+/** R = B - A * X, in double, in parallel; returns the backward error */
+template <typename T>
+double residual(const basic_matrix_t<T> &A, const vector_t &B,
+                const vector_t &X, vector_t &R) {
+  int n = A.getSize();
+  // each task returns (max |r_i|, max row sum of |A|)
+  typedef std::pair<double, double> norms_t;
+  norms_t norms = parallel_reduce(
+      blocked_range<int>(0, n, tiling().rows(n)), norms_t(0, 0),
+      [&](const blocked_range<int> &r, norms_t m) {
+        for (int i = r.begin(); i != r.end(); ++i) {
+          double s = B[i], a = 0;
+          for (int j = 0; j < n; ++j) {
+            s -= A[i][j] * X[j];
+            a += abs(A[i][j]);
+          }
+          R[i] = s;
+          m.first = std::max(m.first, abs(s));
+          m.second = std::max(m.second, a);
+        }
+        return m;
+      },
+      [](norms_t a, norms_t b) {
+        return norms_t(std::max(a.first, b.first),
+                       std::max(a.second, b.second));
+      });
+  double xnorm = 0, bnorm = 0;
+  for (int i = 0; i < n; ++i) {
+    xnorm = std::max(xnorm, abs(X[i]));
+    bnorm = std::max(bnorm, abs(B[i]));
+  }
+  // an empty system, or b = 0 solved by x = 0, is solved exactly
+  double scale = norms.second * xnorm + bnorm;
+  return scale > 0 ? norms.first / scale : norms.first > 0 ? INFINITY : 0;
+}
+
+/**
+ * Solve A * x = b paying for stability only when the matrix needs it.
+ *
+ * The fast path factors a float copy of A without pivoting, a panel of
+ * columns at a time in Crout order, watching the growth of U.  Before each
+ * panel, the part of the matrix that the panel will overwrite is saved.  If
+ * growth passes the threshold of growthMonitor() or a pivot vanishes, that
+ * panel is restored and the factorization continues from it with partial
+ * pivoting; the earlier panels are kept.  The float answer is then refined
+ * in double against A.  If refinement stalls short of double accuracy, A
+ * is refactored in double with partial pivoting.
+ */
+void adaptiveSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  int n = A.getSize(), nb = tiling().micro;
+  escalation_t &report = escalationReport();
+  report = escalation_t();
+  report.used = true;
+
+  basic_matrix_t<float> F(n);
+  parallel_for(blocked_range<int>(0, n, tiling().rows(n)),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i)
+                   std::copy(A[i], A[i] + n, F[i]);
+               });
+  double amax = maxAbs(A), threshold = growthMonitor().threshold;
+  std::vector<int> piv(n);
+  std::vector<float> ucol(n), saved;
+  bool pivoting = false, failed = false;
+  for (int p = 0; p < n && !failed; p += nb) {
+    int e = std::min(n, p + nb);
+    // Without pivoting no row moves, so the panel can only write columns
+    // [p, e) of rows below p, and rows [p, e) right of p
+    if (!pivoting) {
+      saved.clear();
+      for (int i = p; i < n; ++i)
+        saved.insert(saved.end(), F[i] + p, F[i] + (i < e ? n : e));
+    }
+    for (int j = p; j < e; ++j) {
+      sweep_t step = croutStep(F, j, pivoting, piv, ucol);
+      if (pivoting && step.pivot.big == 0.0) {
+        // singular in float: leave it to double
+        failed = true;
+        break;
+      }
+      if (!pivoting && (step.pivot.big == 0.0 || step.big / amax > threshold)) {
+        auto it = saved.begin();
+        for (int i = p; i < n; ++i) {
+          int len = (i < e ? n : e) - p;
+          std::copy(it, it + len, F[i] + p);
+          it += len;
+        }
+        pivoting = true;
+        report.pivotFrom = p;
+        j = p - 1;
+      }
+    }
+  }
+
+  // Refine in double until the backward error is at double precision
+  vector_t R(B), D(n), Y(n);
+  double target = n * DBL_EPSILON, eta = 1, last = 2;
+  for (int i = 0; i < n; ++i)
+    X[i] = 0;
+  while (!failed && eta > target) {
+    if (report.refinements == 10 || eta > last / 2) {
+      failed = true;
+      break;
+    }
+    for (int i = 0; i < n; ++i)
+      D[i] = R[i];
+    luSolve(F, piv, D, Y);
+    for (int i = 0; i < n; ++i)
+      X[i] += Y[i];
+    ++report.refinements;
+    last = eta;
+    eta = residual(A, B, X, R);
+  }
+
+  // The safe path, on the rare matrix that needs it
+  if (failed) {
+    report.doublePrecision = true;
+    vector_t B2(B);
+    crout(A, piv);
+    luSolve(A, piv, B2, X);
+  } else {
+    report.backwardError = eta;
+  }
+}
+
+/**
+ * butterfly_t is a recursive random butterfly transform of the given depth
+ * on vectors of size n, a multiple of 2^depth.  Level l is block diagonal,
+ * with 2^l butterflies (1/sqrt 2) [R0 R1; R0 -R1] of size n / 2^l, and the
+ * transform is the product of the levels, finest first.  R0 and R1 are
+ * random diagonals close to 1, so the transform is well-conditioned; level
+ * l keeps them side by side in r[l], R0 at the top half of each block.
+ */
+struct butterfly_t {
+  int n, depth;
+  std::vector<std::vector<double>> r;
+
+  butterfly_t(int n, int depth, std::mt19937 &gen) : n(n), depth(depth) {
+    std::uniform_real_distribution<double> u(-0.5, 0.5);
+    r.resize(depth, std::vector<double>(n));
+    for (auto &d : r)
+      for (auto &v : d)
+        v = std::exp(u(gen) / 10);
+  }
+
+  /** The half size of the butterflies of level l */
+  int half(int l) const { return n >> (l + 1); }
+
+  /** The top row of pair p of level l; its partner is half(l) below */
+  int top(int l, int p) const {
+    int h = half(l);
+    return p / h * 2 * h + p % h;
+  }
+
+  /** x = W^T * x */
+  void transposeApply(double *x) const {
+    for (int l = depth - 1; l >= 0; --l) {
+      const double *d = r[l].data();
+      for (int p = 0, h = half(l); p < n / 2; ++p) {
+        int i = top(l, p);
+        double t = x[i], b = x[i + h];
+        x[i] = d[i] * (t + b) * M_SQRT1_2;
+        x[i + h] = d[i + h] * (t - b) * M_SQRT1_2;
+      }
+    }
+  }
+
+  /** x = W * x */
+  void apply(double *x) const {
+    for (int l = 0; l < depth; ++l) {
+      const double *d = r[l].data();
+      for (int p = 0, h = half(l); p < n / 2; ++p) {
+        int i = top(l, p);
+        double t = d[i] * x[i], b = d[i + h] * x[i + h];
+        x[i] = (t + b) * M_SQRT1_2;
+        x[i + h] = (t - b) * M_SQRT1_2;
+      }
+    }
+  }
+
+  /**
+   * A = W^T * A.  Each pair of rows is combined whole, so the pairs of a
+   * level are independent and contiguous
+   */
+  void transposeApplyRows(matrix_t &A) const {
+    int cols = A.getSize();
+    for (int l = depth - 1; l >= 0; --l) {
+      const double *d = r[l].data();
+      int h = half(l);
+      parallel_for(blocked_range<int>(0, n / 2, tiling().rows(2 * cols)),
+                   [&](const blocked_range<int> &range) {
+                     for (int p = range.begin(); p != range.end(); ++p) {
+                       int i = top(l, p);
+                       double *t = A[i], *b = A[i + h];
+                       double dt = d[i] * M_SQRT1_2, db = d[i + h] * M_SQRT1_2;
+                       for (int c = 0; c < cols; ++c) {
+                         double x = t[c], y = b[c];
+                         t[c] = dt * (x + y);
+                         b[c] = db * (x - y);
+                       }
+                     }
+                   });
+    }
+  }
+};
+
+/** butterfly_report_t records what rbtSolve() did, for reporting */
+struct butterfly_report_t {
+  /** has rbtSolve() run since this was reset? */
+  bool used = false;
+
+  /** why the path without pivoting failed, or nullptr if it didn't */
+  const char *failure = nullptr;
+
+  /** iterative refinement steps taken */
+  int refinements = 0;
+
+  /**
+   * the normwise backward error of the refined answer, or -1 after the
+   * fallback to crout(), which overwrites A before it can be measured
+   */
+  double backwardError = -1;
+};
+
+/** The record of the latest rbtSolve() */
+butterfly_report_t &butterflyReport() {
+  static butterfly_report_t report;
+  return report;
+}
+
+/**
+ * Solve A * x = b without pivoting, after randomizing A with recursive
+ * butterfly transforms: with U and V random butterflies of depth 2, the
+ * matrix U^T * A * V needs no pivoting with probability close to 1, and
+ * making it costs O(n^2), in parallel.  It is factored in Crout order
+ * without a pivot search or a row swap, and the answer x = V * y is refined
+ * in double against A.  A is padded with the identity to a multiple of 4.
+ *
+ * If a pivot vanishes, the growth passes 1 / sqrt(eps) (past which the
+ * factors have lost half their digits, and refinement can't make up for
+ * them), or refinement stalls, the failure is recorded in butterflyReport() and A
+ * is solved again with crout(), which pivots.  A itself is not modified on
+ * the fast path.
+ */
+void rbtSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  const int depth = 2;
+  int n = A.getSize(), N = (n + (1 << depth) - 1) >> depth << depth;
+  butterfly_report_t &report = butterflyReport();
+  report = butterfly_report_t();
+  report.used = true;
+
+  // The seed is fixed, so that runs are reproducible
+  std::mt19937 gen(N);
+  butterfly_t U(N, depth, gen), V(N, depth, gen);
+
+  // T = U^T * [A 0; 0 I] * V: each row by V on its own, then rows by U
+  matrix_t T(N);
+  parallel_for(blocked_range<int>(0, N, tiling().rows(N)),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i) {
+                   std::fill(T[i], T[i] + N, 0.0);
+                   if (i < n)
+                     std::copy(A[i], A[i] + n, T[i]);
+                   else
+                     T[i][i] = 1;
+                   V.transposeApply(T[i]);
+                 }
+               });
+  U.transposeApplyRows(T);
+
+  double amax = maxAbs(T), threshold = 1 / std::sqrt(DBL_EPSILON);
+  std::vector<int> piv(N);
+  std::vector<double> ucol(N);
+  for (int j = 0; j < N && !report.failure; ++j) {
+    sweep_t step = croutStep(T, j, false, piv, ucol);
+    if (step.pivot.big == 0.0)
+      report.failure = "zero pivot";
+    else if (step.big / amax > threshold)
+      report.failure = "pivot growth";
+  }
+
+  // Refine in double until the backward error is at double precision
+  vector_t R(B), C(N), Y(N);
+  double target = n * DBL_EPSILON, eta = 1, last = 2;
+  for (int i = 0; i < n; ++i)
+    X[i] = 0;
+  while (!report.failure && eta > target) {
+    if (report.refinements == 5 || eta > last / 2) {
+      report.failure = "refinement stalled";
+      break;
+    }
+    for (int i = 0; i < N; ++i)
+      C[i] = i < n ? R[i] : 0;
+    U.transposeApply(&C[0]);
+    luSolve(T, piv, C, Y);
+    V.apply(&Y[0]);
+    for (int i = 0; i < n; ++i)
+      X[i] += Y[i];
+    ++report.refinements;
+    last = eta;
+    eta = residual(A, B, X, R);
+  }
+
+  // Fall back to pivoting
+  if (report.failure) {
+    vector_t B2(B);
+    crout(A, piv);
+    luSolve(A, piv, B2, X);
+  } else {
+    report.backwardError = eta;
+  }
+}
+
+/**
+ * half_t is an IEEE 754 binary16 number, and bfloat16_t the upper half of a
+ * float.  Both are for storage only: they convert to float to be computed
+ * with, and back.  half_t keeps 11 bits of precision and a range of 65504;
+ * bfloat16_t keeps 8 bits and the whole range of a float.
+ */
+struct half_t {
+  uint16_t bits;
+  half_t() = default;
+  half_t(float f);
+  operator float() const;
+};
+
+struct bfloat16_t {
+  uint16_t bits;
+  bfloat16_t() = default;
+  bfloat16_t(float f);
+  operator float() const;
+};
+
+/** Convert a float to binary16, rounding to nearest even */
+half_t::half_t(float f) {
+#ifdef __F16C__
+  bits = _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+  uint16_t sign = std::signbit(f) ? 0x8000 : 0;
+  float a = std::fabs(f);
+  if (std::isnan(f)) {
+    bits = sign | 0x7e00;
+  } else if (a >= 65520.0f) {
+    bits = sign | 0x7c00; // rounds to infinity
+  } else if (a < 6.103515625e-05f) {
+    // subnormal: a multiple of 2^-24, which may round up to the least normal
+    bits = sign | (uint16_t)std::nearbyint(a * 16777216.0f);
+  } else {
+    int e;
+    uint32_t q = (uint32_t)std::nearbyint(std::ldexp(std::frexp(a, &e), 11));
+    if (q == 2048) {
+      q = 1024;
+      ++e;
+    }
+    bits = sign | (uint16_t)((e + 14) << 10 | (q - 1024));
+  }
+#endif
+}
+
+/** Convert binary16 to a float, which is exact */
+half_t::operator float() const {
+#ifdef __F16C__
+  return _cvtsh_ss(bits);
+#else
+  uint32_t sign = (uint32_t)(bits & 0x8000) << 16, exp = (bits >> 10) & 0x1f,
+           man = bits & 0x3ff, x;
+  if (exp == 0) {
+    float f = man * 5.9604644775390625e-08f; // zero or subnormal
+    return sign ? -f : f;
+  }
+  if (exp == 31)
+    x = sign | 0x7f800000 | man << 13;
+  else
+    x = sign | (exp + 112) << 23 | man << 13;
+  float f;
+  std::memcpy(&f, &x, sizeof f);
+  return f;
+#endif
+}
+
+/** Convert a float to bfloat16, rounding to nearest even */
+bfloat16_t::bfloat16_t(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof x);
+  if (std::isnan(f))
+    bits = (x >> 16) | 0x40;
+  else
+    bits = (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+/** Convert bfloat16 to a float, which is exact */
+bfloat16_t::operator float() const {
+  uint32_t x = (uint32_t)bits << 16;
+  float f;
+  std::memcpy(&f, &x, sizeof f);
+  return f;
+}
+
+/**
+ * Widen len narrow numbers to floats, and narrow them back.  These are the
+ * bulk conversions of the half-precision kernels: with F16C, eight halves
+ * at a time; with AVX-512 BF16, sixteen bfloat16s at a time on the way
+ * down (on the way up, bfloat16 is only a shift, which vectorizes anyway).
+ */
+void widen(const half_t *src, float *dst, int len) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= len; i += 8)
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(
+                                  (const __m128i *)(src + i))));
+#endif
+  for (; i < len; ++i)
+    dst[i] = src[i];
+}
+
+void narrow(const float *src, half_t *dst, int len) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= len; i += 8)
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                     _MM_FROUND_TO_NEAREST_INT));
+#endif
+  for (; i < len; ++i)
+    dst[i] = src[i];
+}
+
+void widen(const bfloat16_t *src, float *dst, int len) {
+  for (int i = 0; i < len; ++i)
+    dst[i] = src[i];
+}
+
+void narrow(const float *src, bfloat16_t *dst, int len) {
+  int i = 0;
+#ifdef __AVX512BF16__
+  for (; i + 16 <= len; i += 16)
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        (__m256i)_mm512_cvtneps_pbh(_mm512_loadu_ps(src + i)));
+#endif
+  for (; i < len; ++i)
+    dst[i] = src[i];
+}
+
+/** The dot product of len narrow numbers with len floats, in float */
+template <typename H> float dotWiden(const H *a, const float *b, int len) {
+  float buf[64], s = 0;
+  for (int k = 0; k < len; k += 64) {
+    int m = std::min(64, len - k);
+    widen(a + k, buf, m);
+    for (int t = 0; t < m; ++t)
+      s += buf[t] * b[k + t];
+  }
+  return s;
+}
+
+/**
+ * Factor A in place into L * U, with partial pivoting, in Crout order like
+ * crout(), for a matrix stored in half_t or bfloat16_t.  Every entry is
+ * widened to float in registers as it is used, all arithmetic is in float,
+ * and only the finished entries of L and U are narrowed back.
+ *
+ * Returns false if the matrix is singular in this precision.
+ */
+template <typename H>
+bool halfFactor(basic_matrix_t<H> &A, std::vector<int> &piv) {
+  int n = A.getSize();
+  piv.resize(n);
+  std::vector<float> ucol(n), row(n), lcol(n);
+  for (int j = 0; j < n; ++j) {
+    for (int k = 0; k < j; ++k)
+      ucol[k] = A[k][j];
+
+    // Column j of L, unscaled and in float, and its largest entry
+    pivot_t pivot = parallel_reduce(
+        blocked_range<int>(j, n, tiling().rows(j + 1)), pivot_t{j, -1.0},
+        [&](const blocked_range<int> &r, pivot_t best) {
+          for (int i = r.begin(); i != r.end(); ++i) {
+            lcol[i] = float(A[i][j]) - dotWiden(A[i], ucol.data(), j);
+            best = betterPivot(best, pivot_t{i, abs(lcol[i])});
+          }
+          return best;
+        },
+        betterPivot);
+    if (pivot.big == 0.0)
+      return false;
+    piv[j] = pivot.row;
+    std::swap(A[j], A[pivot.row]);
+    std::swap(lcol[j], lcol[pivot.row]);
+
+    // Row j of U, from the diagonal on, in float until it is finished
+    widen(A[j], row.data(), n);
+    row[j] = lcol[j];
+    A[j][j] = row[j];
+    parallel_for(blocked_range<int>(j + 1, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   std::vector<float> u(r.size());
+                   for (int k = 0; k < j; ++k) {
+                     widen(A[k] + r.begin(), u.data(), r.size());
+                     for (int c = r.begin(); c != r.end(); ++c)
+                       row[c] -= row[k] * u[c - r.begin()];
+                   }
+                   narrow(row.data() + r.begin(), A[j] + r.begin(), r.size());
+                 });
+
+    // Column j of L is finished once it is scaled by the pivot
+    float d = row[j];
+    parallel_for(blocked_range<int>(j + 1, n, tiling().rows(j + 1)),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i)
+                     A[i][j] = lcol[i] / d;
+                 });
+  }
+  return true;
+}
+
+/**
+ * Solve A * x = b with the factors stored in half precision (half_t or
+ * bfloat16_t), which takes a quarter of the memory of double factors, and
+ * recover double accuracy by iterative refinement against A.
+ *
+ * A is scaled by a power of two before it is narrowed, so its largest entry
+ * is 1 and binary16 has its full range left for growth.  Each refinement
+ * step gains about the precision of the factors, so more steps are allowed
+ * than with float factors; if refinement still stalls (when the condition
+ * number of A is near the inverse of that precision), A is solved again
+ * with crout() in double, as adaptiveSolve() does, and the report says so.
+ */
+template <typename H> void halfSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  int n = A.getSize();
+  escalation_t &report = escalationReport();
+  report = escalation_t();
+  report.used = true;
+  report.pivotFrom = 0;
+  report.storage = std::is_same<H, half_t>::value ? "fp16" : "bf16";
+
+  double amax = maxAbs(A);
+  double scale = amax > 0 ? std::exp2(std::ceil(std::log2(amax))) : 1;
+  basic_matrix_t<H> F(n);
+  parallel_for(blocked_range<int>(0, n, tiling().rows(n)),
+               [&](const blocked_range<int> &r) {
+                 std::vector<float> row(n);
+                 for (int i = r.begin(); i != r.end(); ++i) {
+                   for (int j = 0; j < n; ++j)
+                     row[j] = A[i][j] / scale;
+                   narrow(row.data(), F[i], n);
+                 }
+               });
+  std::vector<int> piv;
+  bool failed = !halfFactor(F, piv);
+
+  // Refine in double until the backward error is at double precision
+  vector_t R(B), D(n), Y(n);
+  double target = n * DBL_EPSILON, eta = 1, last = 2;
+  for (int i = 0; i < n; ++i)
+    X[i] = 0;
+  while (!failed && eta > target) {
+    if (report.refinements == 30 || eta > last * 0.9) {
+      failed = true;
+      break;
+    }
+    for (int i = 0; i < n; ++i)
+      D[i] = R[i];
+    luSolve(F, piv, D, Y);
+    for (int i = 0; i < n; ++i)
+      X[i] += Y[i] / scale;
+    ++report.refinements;
+    last = eta;
+    eta = residual(A, B, X, R);
+  }
+
+  // The safe path, when the factors are too coarse for this matrix
+  if (failed) {
+    report.doublePrecision = true;
+    vector_t B2(B);
+    crout(A, piv);
+    luSolve(A, piv, B2, X);
+  } else {
+    report.backwardError = eta;
+  }
+}
+
+/**
+ * Factor T in place into L * U with partial pivoting, a tile column at a
+ * time, right-looking.  The panel of tile column K is factored on its own,
+ * with its row swaps confined to that tile column; the swaps are then
+ * applied to the other tile columns in parallel (a column-blocked LASWP),
+ * the tiles of U right of the diagonal are solved in parallel, and every
+ * trailing tile is updated by a product of two whole tiles, each of them
+ * contiguous.
+ */
+void tiledFactor(tiled_matrix_t &T, std::vector<int> &piv) {
+  int n = T.getSize(), t = T.getTiles(), b = T.getEdge();
+  piv.resize(n);
+  for (int K = 0; K < t; ++K) {
+    int k0 = K * b;
+    // The panel, a column at a time
+    for (int j = k0; j < k0 + b; ++j) {
+      pivot_t pivot = parallel_reduce(
+          blocked_range<int>(j, n, tiling().rows(b)), pivot_t{j, -1.0},
+          [&](const blocked_range<int> &r, pivot_t best) {
+            for (int i = r.begin(); i != r.end(); ++i)
+              best = betterPivot(best, pivot_t{i, abs(T.rowOf(i, K)[j - k0])});
+            return best;
+          },
+          betterPivot);
+      if (pivot.big == 0.0)
+        throw singular_matrix_t();
+      piv[j] = pivot.row;
+      if (pivot.row != j)
+        std::swap_ranges(T.rowOf(j, K), T.rowOf(j, K) + b,
+                         T.rowOf(pivot.row, K));
+      const double *u = T.rowOf(j, K);
+      double d = u[j - k0];
+      parallel_for(blocked_range<int>(j + 1, n, tiling().rows(b)),
+                   [&](const blocked_range<int> &r) {
+                     for (int i = r.begin(); i != r.end(); ++i) {
+                       double *row = T.rowOf(i, K), c = row[j - k0] /= d;
+                       for (int q = j - k0 + 1; q < b; ++q)
+                         row[q] -= c * u[q];
+                     }
+                   });
+    }
+
+    // The panel's swaps, in the other tile columns
+    parallel_for(blocked_range<int>(0, t), [&](const blocked_range<int> &r) {
+      for (int J = r.begin(); J != r.end(); ++J)
+        if (J != K)
+          for (int j = k0; j < k0 + b; ++j)
+            if (piv[j] != j)
+              std::swap_ranges(T.rowOf(j, J), T.rowOf(j, J) + b,
+                               T.rowOf(piv[j], J));
+    });
+
+    // U right of the diagonal tile: solve with its unit lower triangle
+    const double *L = T.tile(K, K);
+    parallel_for(blocked_range<int>(K + 1, t), [&](const blocked_range<int> &r) {
+      for (int J = r.begin(); J != r.end(); ++J) {
+        double *U = T.tile(K, J);
+        for (int a = 1; a < b; ++a)
+          for (int q = 0; q < a; ++q) {
+            double l = L[a * b + q];
+            for (int c = 0; c < b; ++c)
+              U[a * b + c] -= l * U[q * b + c];
+          }
+      }
+    });
+
+    // The trailing tiles
+    parallel_for(blocked_range2d<int>(K + 1, t, K + 1, t),
+                 [&](const blocked_range2d<int> &r) {
+                   for (int I = r.rows().begin(); I != r.rows().end(); ++I)
+                     for (int J = r.cols().begin(); J != r.cols().end(); ++J) {
+                       double *C = T.tile(I, J);
+                       const double *A = T.tile(I, K), *B = T.tile(K, J);
+                       for (int a = 0; a < b; ++a)
+                         for (int q = 0; q < b; ++q) {
+                           double l = A[a * b + q];
+                           for (int c = 0; c < b; ++c)
+                             C[a * b + c] -= l * B[q * b + c];
+                         }
+                     }
+                 });
+  }
+}
+
+/**
+ * Solve A * x = b by factoring a tiled, Z-ordered copy of A.  The tile edge
+ * is the largest power of two that fits the micro tile of tiling().
+ */
+void tiledSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  int n = A.getSize(), shift = 0;
+  while ((2 << shift) <= tiling().micro)
+    ++shift;
+  tiled_matrix_t T(A, shift);
+  std::vector<int> piv;
+  tiledFactor(T, piv);
+
+  int N = T.getSize(), t = T.getTiles(), b = T.getEdge();
+  vector_t Y(N);
+  for (int i = 0; i < N; ++i)
+    Y[i] = i < n ? B[i] : 0;
+  applyInterchanges(piv, Y);
+
+  // Forward with L, a tile row at a time
+  for (int I = 0; I < t; ++I) {
+    double *y = &Y[I * b];
+    for (int J = 0; J < I; ++J) {
+      const double *L = T.tile(I, J), *x = &Y[J * b];
+      for (int a = 0; a < b; ++a)
+        for (int c = 0; c < b; ++c)
+          y[a] -= L[a * b + c] * x[c];
+    }
+    const double *L = T.tile(I, I);
+    for (int a = 0; a < b; ++a)
+      for (int c = 0; c < a; ++c)
+        y[a] -= L[a * b + c] * y[c];
+  }
+
+  // Back with U, from the bottom
+  for (int I = t - 1; I >= 0; --I) {
+    double *y = &Y[I * b];
+    for (int J = I + 1; J < t; ++J) {
+      const double *U = T.tile(I, J), *x = &Y[J * b];
+      for (int a = 0; a < b; ++a)
+        for (int c = 0; c < b; ++c)
+          y[a] -= U[a * b + c] * x[c];
+    }
+    const double *U = T.tile(I, I);
+    for (int a = b - 1; a >= 0; --a) {
+      for (int c = a + 1; c < b; ++c)
+        y[a] -= U[a * b + c] * y[c];
+      y[a] /= U[a * b + a];
+    }
+  }
+  for (int i = 0; i < n; ++i)
+    X[i] = Y[i];
+}
+
+#ifdef GAUSS_WITH_LAPACK
+/** LAPACK's Fortran entry point, as exported by OpenBLAS, BLIS and MKL */
+extern "C" void dgesv_(const int *n, const int *nrhs, double *a,
+                       const int *lda, int *ipiv, double *b, const int *ldb,
+                       int *info);
+
+/**
+ * Solve A * x = b with the vendor LAPACK's dgesv, for comparison with the
+ * native solvers and as a fallback.  LAPACK wants a single column-major
+ * array, so A is transposed into one, a tile at a time, first.
+ */
+void lapackSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  int n = A.getSize(), nrhs = 1, info = 0;
+  std::vector<double> a((std::size_t)n * n);
+  std::vector<int> ipiv(n);
+  int m = tiling().micro;
+  parallel_for(blocked_range2d<int>(0, n, m, 0, n, m),
+               [&](const blocked_range2d<int> &r) {
+                 for (int i = r.rows().begin(); i != r.rows().end(); ++i)
+                   for (int j = r.cols().begin(); j != r.cols().end(); ++j)
+                     a[(std::size_t)j * n + i] = A[i][j];
+               });
+  for (int i = 0; i < n; ++i)
+    X[i] = B[i];
+  dgesv_(&n, &nrhs, a.data(), &n, ipiv.data(), &X[0], &n, &info);
+  if (info > 0)
+    throw singular_matrix_t();
+}
+#endif
+
+/**
+ * Factor the small dense row-major n x n matrix a in place into L * U with
+ * partial pivoting, for the leaves and capacitance systems of hodlr_t.
+ * Returns false if a is singular.
+ */
+bool denseFactor(std::vector<double> &a, int n, std::vector<int> &piv) {
+  piv.resize(n);
+  for (int i = 0; i < n; ++i) {
+    int row = i;
+    for (int k = i + 1; k < n; ++k)
+      if (abs(a[k * n + i]) > abs(a[row * n + i]))
+        row = k;
+    if (a[row * n + i] == 0.0)
+      return false;
+    piv[i] = row;
+    if (row != i)
+      std::swap_ranges(&a[i * n], &a[i * n] + n, &a[row * n]);
+    for (int k = i + 1; k < n; ++k) {
+      double c = a[k * n + i] /= a[i * n + i];
+      for (int j = i + 1; j < n; ++j)
+        a[k * n + j] -= c * a[i * n + j];
+    }
+  }
+  return true;
+}
+
+/**
+ * Overwrite the row-major n x m block X with the solution of A * X = X,
+ * given the factors from denseFactor()
+ */
+void denseSolve(const std::vector<double> &a, int n,
+                const std::vector<int> &piv, double *X, int m) {
+  for (int i = 0; i < n; ++i)
+    if (piv[i] != i)
+      std::swap_ranges(X + i * m, X + i * m + m, X + piv[i] * m);
+  for (int i = 0; i < n; ++i)
+    for (int k = 0; k < i; ++k)
+      for (int c = 0; c < m; ++c)
+        X[i * m + c] -= a[i * n + k] * X[k * m + c];
+  for (int i = n - 1; i >= 0; --i) {
+    for (int k = i + 1; k < n; ++k)
+      for (int c = 0; c < m; ++c)
+        X[i * m + c] -= a[i * n + k] * X[k * m + c];
+    for (int c = 0; c < m; ++c)
+      X[i * m + c] /= a[i * n + i];
+  }
+}
+
+/**
+ * lowrank_t is a rows x cols block held as U * V^T, with U (rows x rank)
+ * and V (cols x rank) both row-major
+ */
+struct lowrank_t {
+  int rank = 0;
+  std::vector<double> U, V;
+};
+
+/**
+ * Compress the block of rows [r0, r0+nr) and columns [c0, c0+nc) of the
+ * matrix whose entries are given by entry(), by adaptive cross
+ * approximation with partial pivoting.  Only O(rank * (nr + nc)) entries are
+ * ever evaluated.  Stops when the newest cross is below tol relative to the
+ * (estimated) Frobenius norm of the approximation so far.
+ */
+lowrank_t aca(const std::function<double(int, int)> &entry, int r0, int nr,
+              int c0, int nc, double tol) {
+  lowrank_t lr;
+  std::vector<std::vector<double>> us, vs;
+  std::vector<bool> usedRow(nr, false);
+  double norm2 = 0;
+  int pivotRow = 0;
+  for (int tries = 0; (int)us.size() < std::min(nr, nc) && tries < nr;) {
+    // the residual of the pivot row
+    usedRow[pivotRow] = true;
+    std::vector<double> v(nc);
+    for (int j = 0; j < nc; ++j)
+      v[j] = entry(r0 + pivotRow, c0 + j);
+    for (std::size_t l = 0; l < us.size(); ++l)
+      for (int j = 0; j < nc; ++j)
+        v[j] -= us[l][pivotRow] * vs[l][j];
+    int col = 0;
+    for (int j = 1; j < nc; ++j)
+      if (abs(v[j]) > abs(v[col]))
+        col = j;
+
+    // an exactly zero residual row says nothing: try the next unused row
+    if (v[col] == 0.0) {
+      ++tries;
+      pivotRow = std::find(usedRow.begin(), usedRow.end(), false) -
+                 usedRow.begin();
+      if (pivotRow == nr)
+        break;
+      continue;
+    }
+    double scale = v[col];
+    for (int j = 0; j < nc; ++j)
+      v[j] /= scale;
+
+    // the residual of the pivot column
+    std::vector<double> u(nr);
+    for (int i = 0; i < nr; ++i)
+      u[i] = entry(r0 + i, c0 + col);
+    for (std::size_t l = 0; l < us.size(); ++l)
+      for (int i = 0; i < nr; ++i)
+        u[i] -= vs[l][col] * us[l][i];
+
+    // update the norm estimate: |S + u v^T|^2
+    double uu = 0, vv = 0;
+    for (double x : u)
+      uu += x * x;
+    for (double x : v)
+      vv += x * x;
+    for (std::size_t l = 0; l < us.size(); ++l) {
+      double uul = 0, vvl = 0;
+      for (int i = 0; i < nr; ++i)
+        uul += u[i] * us[l][i];
+      for (int j = 0; j < nc; ++j)
+        vvl += v[j] * vs[l][j];
+      norm2 += 2 * uul * vvl;
+    }
+    norm2 += uu * vv;
+    us.push_back(std::move(u));
+    vs.push_back(std::move(v));
+    if (uu * vv <= tol * tol * norm2)
+      break;
+
+    // the next pivot row is the largest unused entry of the new column
+    pivotRow = -1;
+    for (int i = 0; i < nr; ++i)
+      if (!usedRow[i] && (pivotRow < 0 || abs(us.back()[i]) >
+                                              abs(us.back()[pivotRow])))
+        pivotRow = i;
+    if (pivotRow < 0)
+      break;
+  }
+  lr.rank = us.size();
+  lr.U.resize((std::size_t)nr * lr.rank);
+  lr.V.resize((std::size_t)nc * lr.rank);
+  for (int l = 0; l < lr.rank; ++l) {
+    for (int i = 0; i < nr; ++i)
+      lr.U[(std::size_t)i * lr.rank + l] = us[l][i];
+    for (int j = 0; j < nc; ++j)
+      lr.V[(std::size_t)j * lr.rank + l] = vs[l][j];
+  }
+  return lr;
+}
+
+/**
+ * hodlr_t is a hierarchically off-diagonal low-rank (HODLR) representation
+ * of an n x n matrix that is given only by a function for its entries.  The
+ * index range is split in half recursively; at every level the two
+ * off-diagonal blocks are compressed by aca(), and the leaves are dense.
+ * When the off-diagonal blocks are numerically low-rank, as for smooth
+ * kernels, storage is O(n log n) and factoring and solving are about
+ * O(n log^2 n), so there is never an n x n array.
+ *
+ * The factorization is the recursive Sherman-Morrison-Woodbury one: a node
+ * is D + U Z with D = diag(A11, A22), U = diag(U1, U2) and Z built from V1
+ * and V2, so a solve is two child solves and one small capacitance solve.
+ */
+class hodlr_t {
+  struct node_t {
+    /** the index range [begin, end) this node covers */
+    int begin, end;
+
+    /** the two halves, or none for a leaf */
+    std::unique_ptr<node_t> child[2];
+
+    /** A(first half, second half) and A(second half, first half) */
+    lowrank_t a12, a21;
+
+    /** A11^{-1} U1 and A22^{-1} U2, row-major */
+    std::vector<double> y1, y2;
+
+    /** a leaf's dense LU, or the capacitance matrix's LU, and its pivots */
+    std::vector<double> lu;
+    std::vector<int> piv;
+  };
+
+  std::unique_ptr<node_t> root;
+  std::function<double(int, int)> entry;
+  int size;
+  double tol;
+  int leaf;
+
+  /** Build the tree under [begin, end) and compress its off-diagonals */
+  std::unique_ptr<node_t> build(int begin, int end) {
+    std::unique_ptr<node_t> t(new node_t);
+    t->begin = begin;
+    t->end = end;
+    if (end - begin <= leaf)
+      return t;
+    int mid = begin + (end - begin) / 2;
+    parallel_invoke([&] { t->child[0] = build(begin, mid); },
+                    [&] { t->child[1] = build(mid, end); },
+                    [&] { t->a12 = aca(entry, begin, mid - begin, mid,
+                                       end - mid, tol); },
+                    [&] { t->a21 = aca(entry, mid, end - mid, begin,
+                                       mid - begin, tol); });
+    return t;
+  }
+
+  /**
+   * Overwrite the row-major (end - begin) x m block X with the solution of
+   * A(t) * X = X
+   */
+  void solve(const node_t *t, double *X, int m) const {
+    int n = t->end - t->begin;
+    if (!t->child[0]) {
+      denseSolve(t->lu, n, t->piv, X, m);
+      return;
+    }
+    int n1 = t->child[0]->end - t->begin, n2 = n - n1;
+    double *X2 = X + (std::size_t)n1 * m;
+    parallel_invoke([&] { solve(t->child[0].get(), X, m); },
+                    [&] { solve(t->child[1].get(), X2, m); });
+
+    // s = K^{-1} Z x, where Z x = [V1^T x2; V2^T x1]
+    int r1 = t->a12.rank, r2 = t->a21.rank;
+    std::vector<double> s((std::size_t)(r1 + r2) * m, 0.0);
+    for (int i = 0; i < n2; ++i)
+      for (int l = 0; l < r1; ++l)
+        for (int c = 0; c < m; ++c)
+          s[l * m + c] += t->a12.V[i * r1 + l] * X2[(std::size_t)i * m + c];
+    for (int i = 0; i < n1; ++i)
+      for (int l = 0; l < r2; ++l)
+        for (int c = 0; c < m; ++c)
+          s[(r1 + l) * m + c] +=
+              t->a21.V[i * r2 + l] * X[(std::size_t)i * m + c];
+    if (r1 + r2 > 0)
+      denseSolve(t->lu, r1 + r2, t->piv, s.data(), m);
+
+    // x -= D^{-1} U s
+    for (int i = 0; i < n1; ++i)
+      for (int l = 0; l < r1; ++l)
+        for (int c = 0; c < m; ++c)
+          X[(std::size_t)i * m + c] -= t->y1[i * r1 + l] * s[l * m + c];
+    for (int i = 0; i < n2; ++i)
+      for (int l = 0; l < r2; ++l)
+        for (int c = 0; c < m; ++c)
+          X2[(std::size_t)i * m + c] -=
+              t->y2[i * r2 + l] * s[(r1 + l) * m + c];
+  }
+
+  /**
+   * Factor the subtree under t, children first; returns false if some block
+   * was singular.  Each child reports for itself, so the two can run at once.
+   */
+  bool factor(node_t *t) {
+    int n = t->end - t->begin;
+    if (!t->child[0]) {
+      t->lu.resize((std::size_t)n * n);
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+          t->lu[i * n + j] = entry(t->begin + i, t->begin + j);
+      return denseFactor(t->lu, n, t->piv);
+    }
+    bool ok0, ok1;
+    parallel_invoke([&] { ok0 = factor(t->child[0].get()); },
+                    [&] { ok1 = factor(t->child[1].get()); });
+    if (!ok0 || !ok1)
+      return false;
+    int n1 = t->child[0]->end - t->begin, n2 = n - n1;
+    int r1 = t->a12.rank, r2 = t->a21.rank;
+    t->y1 = t->a12.U;
+    t->y2 = t->a21.U;
+    parallel_invoke([&] { solve(t->child[0].get(), t->y1.data(), r1); },
+                    [&] { solve(t->child[1].get(), t->y2.data(), r2); });
+
+    // K = I + Z D^{-1} U = [I, V1^T Y2; V2^T Y1, I]
+    int r = r1 + r2;
+    t->lu.assign((std::size_t)r * r, 0.0);
+    for (int l = 0; l < r; ++l)
+      t->lu[l * r + l] = 1;
+    for (int i = 0; i < n2; ++i)
+      for (int a = 0; a < r1; ++a)
+        for (int b = 0; b < r2; ++b)
+          t->lu[a * r + r1 + b] += t->a12.V[i * r1 + a] * t->y2[i * r2 + b];
+    for (int i = 0; i < n1; ++i)
+      for (int a = 0; a < r2; ++a)
+        for (int b = 0; b < r1; ++b)
+          t->lu[(r1 + a) * r + b] += t->a21.V[i * r2 + a] * t->y1[i * r1 + b];
+    return r == 0 || denseFactor(t->lu, r, t->piv);
+  }
+
+  /** Gather the ranks and storage of the subtree under t */
+  void stats(const node_t *t, int &maxrank, std::size_t &doubles) const {
+    doubles += t->lu.size() + t->a12.U.size() + t->a12.V.size() +
+               t->a21.U.size() + t->a21.V.size() + t->y1.size() + t->y2.size();
+    maxrank = std::max(maxrank, std::max(t->a12.rank, t->a21.rank));
+    for (auto &c : t->child)
+      if (c)
+        stats(c.get(), maxrank, doubles);
+  }
+
+public:
+  /**
+   * Build the compressed form of the n x n matrix with the given entries,
+   * to relative accuracy tol, with dense leaves of at most leafSize rows
+   */
+  hodlr_t(std::function<double(int, int)> f, int n, double tolerance = 1e-12,
+          int leafSize = 64)
+      : entry(std::move(f)), size(n), tol(tolerance), leaf(leafSize) {
+    root = build(0, n);
+  }
+
+  /** Factor the matrix; returns false if some block was singular */
+  bool factor() { return factor(root.get()); }
+
+  /** Solve A * x = b for the factored matrix */
+  void solve(vector_t &B, vector_t &X) const {
+    for (int i = 0; i < size; ++i)
+      X[i] = B[i];
+    solve(root.get(), &X[0], 1);
+  }
+
+  /** The largest off-diagonal rank */
+  int maxRank() const {
+    int r = 0;
+    std::size_t d = 0;
+    stats(root.get(), r, d);
+    return r;
+  }
+
+  /** The storage, in bytes, of the compressed matrix and its factors */
+  std::size_t bytes() const {
+    int r = 0;
+    std::size_t d = 0;
+    stats(root.get(), r, d);
+    return d * sizeof(double);
+  }
+};
+
+/**
+ * Solve A * x = b through a HODLR compression of A.  Dense matrices from the
+ * differential test are generally not low-rank, so this mainly checks that
+ * the compression and the recursive solve lose nothing when ranks are full
+ */
+void hodlrSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  hodlr_t H([&](int i, int j) { return A[i][j]; }, A.getSize(), 1e-15, 16);
+  if (!H.factor())
+    throw singular_matrix_t();
+  H.solve(B, X);
+}
+
+/**
+ * kernel_system_t is the discretization of a second-kind integral equation
+ * with a smooth kernel, x(s) + integral k(s,t) x(t) dt = b(s) on [0,1]: its
+ * matrix is I + K/n with K(i,j) = 1 / (1 + 100 (t_i - t_j)^2) at sorted
+ * random points t_i.  Its off-diagonal blocks are numerically low-rank,
+ * and every entry can be computed on demand, so it scales to any n.
+ */
+struct kernel_system_t {
+  std::vector<double> t;
+
+  /** Scatter the n points from a seed */
+  kernel_system_t(int seed, int n) : t(n) {
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<double> u(0, 1);
+    for (auto &x : t)
+      x = u(mt);
+    std::sort(t.begin(), t.end());
+  }
+
+  /** Entry (i, j) of the matrix */
+  double operator()(int i, int j) const {
+    double d = t[i] - t[j];
+    return (i == j) + 1.0 / (1 + 100 * d * d) / t.size();
+  }
+};
+
+/**
+ * linear_operator_t is a square matrix known only by what it does to a
+ * vector.  The iterative solvers take one of these instead of a matrix_t,
+ * so that operators which are cheap to apply but expensive to store, such
+ * as stencils and convolutions, never need O(n^2) memory.
+ */
+class linear_operator_t {
+public:
+  virtual ~linear_operator_t() {}
+
+  /** the # rows / # columns */
+  virtual unsigned int getSize() const = 0;
+
+  /** Y = A * X */
+  virtual void apply(const vector_t &X, vector_t &Y) const = 0;
+
+  /** Y = A^T * X */
+  virtual void applyTranspose(const vector_t &X, vector_t &Y) const = 0;
+
+  /** D = the diagonal of A */
+  virtual void diagonal(vector_t &D) const = 0;
+};
+
+/** dense_operator_t lets an iterative solver work on a matrix_t */
+class dense_operator_t : public linear_operator_t {
+  const matrix_t &A;
+
+public:
+  dense_operator_t(const matrix_t &a) : A(a) {}
+  unsigned int getSize() const { return A.getSize(); }
+  void apply(const vector_t &X, vector_t &Y) const {
+    int n = A.getSize();
+    parallel_for(blocked_range<int>(0, n, tiling().rows(n)),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     double s = 0;
+                     for (int j = 0; j < n; ++j)
+                       s += A[i][j] * X[j];
+                     Y[i] = s;
+                   }
+                 });
+  }
+  void applyTranspose(const vector_t &X, vector_t &Y) const {
+    // split the output into column ranges, so rows are read contiguously
+    int n = A.getSize();
+    parallel_for(blocked_range<int>(0, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int j = r.begin(); j != r.end(); ++j)
+                     Y[j] = 0;
+                   for (int i = 0; i < n; ++i)
+                     for (int j = r.begin(); j != r.end(); ++j)
+                       Y[j] += A[i][j] * X[i];
+                 });
+  }
+  void diagonal(vector_t &D) const {
+    int n = A.getSize();
+    for (int i = 0; i < n; ++i)
+      D[i] = A[i][i];
+  }
+};
+
+/**
+ * stencil2d_t is a five-point stencil on an m x m grid with zero
+ * (Dirichlet) boundaries, numbered row by row.  With weights (4, -1, -1,
+ * -1, -1) it is the Poisson operator; unequal east/west or north/south
+ * weights make it a convection-diffusion operator.
+ */
+class stencil2d_t : public linear_operator_t {
+  int m;
+  double center, west, east, south, north;
+
+  /** Y = the stencil with the given neighbour weights, applied to X */
+  void sweep(const vector_t &X, vector_t &Y, double w, double e, double s,
+             double nn) const {
+    parallel_for(blocked_range<int>(0, m), [&](const blocked_range<int> &r) {
+      for (int y = r.begin(); y != r.end(); ++y)
+        for (int x = 0; x < m; ++x) {
+          int i = y * m + x;
+          double v = center * X[i];
+          if (x > 0)
+            v += w * X[i - 1];
+          if (x < m - 1)
+            v += e * X[i + 1];
+          if (y > 0)
+            v += s * X[i - m];
+          if (y < m - 1)
+            v += nn * X[i + m];
+          Y[i] = v;
+        }
+    });
+  }
+
+public:
+  stencil2d_t(int gridSize, double c, double w, double e, double s, double n)
+      : m(gridSize), center(c), west(w), east(e), south(s), north(n) {}
+  unsigned int getSize() const { return m * m; }
+  void apply(const vector_t &X, vector_t &Y) const {
+    sweep(X, Y, west, east, south, north);
+  }
+  void applyTranspose(const vector_t &X, vector_t &Y) const {
+    // the transpose reaches each neighbour with the opposite weight
+    sweep(X, Y, east, west, north, south);
+  }
+  void diagonal(vector_t &D) const {
+    for (int i = 0; i < m * m; ++i)
+      D[i] = center;
+  }
+};
+
+/**
+ * convolution_t is a 1-d convolution of a length-n signal with a short
+ * kernel centred on each point, treating the signal as zero outside
+ */
+class convolution_t : public linear_operator_t {
+  int n;
+  std::vector<double> taps;
+
+  /** Y = X convolved with the taps, read forwards or backwards */
+  void convolve(const vector_t &X, vector_t &Y, bool reversed) const {
+    int h = taps.size() / 2;
+    parallel_for(blocked_range<int>(0, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     double v = 0;
+                     for (int k = -h; k <= h; ++k)
+                       if (i + k >= 0 && i + k < n)
+                         v += taps[h + (reversed ? -k : k)] * X[i + k];
+                     Y[i] = v;
+                   }
+                 });
+  }
+
+public:
+  /** The taps must have odd length; the middle one is the diagonal */
+  convolution_t(int size, std::vector<double> t) : n(size), taps(t) {}
+  unsigned int getSize() const { return n; }
+  void apply(const vector_t &X, vector_t &Y) const { convolve(X, Y, false); }
+  void applyTranspose(const vector_t &X, vector_t &Y) const {
+    convolve(X, Y, true);
+  }
+  void diagonal(vector_t &D) const {
+    for (int i = 0; i < n; ++i)
+      D[i] = taps[taps.size() / 2];
+  }
+};
+
+/** The dot product of two vectors, in parallel */
+double dot(const vector_t &X, const vector_t &Y) {
+  return parallel_reduce(
+      blocked_range<int>(0, X.getSize(), tiling().strip), 0.0,
+      [&](const blocked_range<int> &r, double s) {
+        for (int i = r.begin(); i != r.end(); ++i)
+          s += X[i] * Y[i];
+        return s;
+      },
+      std::plus<double>());
+}
+
+/** Y = a * X + b * Y, in parallel */
+void axpby(double a, const vector_t &X, double b, vector_t &Y) {
+  parallel_for(blocked_range<int>(0, X.getSize(), tiling().strip),
+               [&](const blocked_range<int> &r) {
+                 for (int i = r.begin(); i != r.end(); ++i)
+                   Y[i] = a * X[i] + b * Y[i];
+               });
+}
+
+/** What an iterative solve achieved */
+struct iterative_result_t {
+  int iterations;
+
+  /** the final ||b - A x|| / ||b|| */
+  double residual;
+  bool converged;
+};
+
+/**
+ * Solve A * x = b with Jacobi-preconditioned BiCGSTAB, which handles
+ * nonsymmetric operators.  X is the initial guess on entry.  Stops when
+ * the relative residual is below tol, or after maxit iterations.
+ */
+iterative_result_t bicgstab(const linear_operator_t &A, const vector_t &B,
+                            vector_t &X, double tol, int maxit) {
+  int n = A.getSize();
+  vector_t R(n), R0(n), P(n), V(n), S(n), T(n), D(n), Y(n), Z(n);
+  A.diagonal(D);
+  A.apply(X, R);
+  axpby(1, B, -1, R);
+  for (int i = 0; i < n; ++i) {
+    R0[i] = R[i];
+    P[i] = V[i] = 0;
+  }
+  double bnorm = std::sqrt(dot(B, B)), rho = 1, alpha = 1, omega = 1;
+  if (bnorm == 0)
+    bnorm = 1;
+  iterative_result_t res{0, std::sqrt(dot(R, R)) / bnorm, false};
+  while (res.residual > tol && res.iterations < maxit) {
+    ++res.iterations;
+    double rhoNew = dot(R0, R);
+    if (rhoNew == 0 || omega == 0)
+      break;
+    double beta = rhoNew / rho * alpha / omega;
+    rho = rhoNew;
+    // P = R + beta (P - omega V), then Y = M^{-1} P
+    parallel_for(blocked_range<int>(0, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     P[i] = R[i] + beta * (P[i] - omega * V[i]);
+                     Y[i] = P[i] / D[i];
+                   }
+                 });
+    A.apply(Y, V);
+    alpha = rho / dot(R0, V);
+    // S = R - alpha V, then Z = M^{-1} S
+    parallel_for(blocked_range<int>(0, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     S[i] = R[i] - alpha * V[i];
+                     Z[i] = S[i] / D[i];
+                   }
+                 });
+    A.apply(Z, T);
+    double tt = dot(T, T);
+    omega = tt == 0 ? 0 : dot(T, S) / tt;
+    parallel_for(blocked_range<int>(0, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     X[i] += alpha * Y[i] + omega * Z[i];
+                     R[i] = S[i] - omega * T[i];
+                   }
+                 });
+    res.residual = std::sqrt(dot(R, R)) / bnorm;
+  }
+  res.converged = res.residual <= tol;
+  return res;
+}
+
+/**
+ * Solve A * x = b with CGNR: conjugate gradients on A^T A x = A^T b.  It
+ * converges for any nonsingular operator, at the price of squaring the
+ * condition number, and it is what applyTranspose() is for.  X is the
+ * initial guess on entry.
+ */
+iterative_result_t cgnr(const linear_operator_t &A, const vector_t &B,
+                        vector_t &X, double tol, int maxit) {
+  int n = A.getSize();
+  vector_t R(n), Z(n), P(n), W(n);
+  A.apply(X, R);
+  axpby(1, B, -1, R);
+  A.applyTranspose(R, Z);
+  for (int i = 0; i < n; ++i)
+    P[i] = Z[i];
+  double bnorm = std::sqrt(dot(B, B)), zz = dot(Z, Z);
+  if (bnorm == 0)
+    bnorm = 1;
+  iterative_result_t res{0, std::sqrt(dot(R, R)) / bnorm, false};
+  while (res.residual > tol && res.iterations < maxit && zz > 0) {
+    ++res.iterations;
+    A.apply(P, W);
+    double alpha = zz / dot(W, W);
+    axpby(alpha, P, 1, X);
+    axpby(-alpha, W, 1, R);
+    A.applyTranspose(R, Z);
+    double zzNew = dot(Z, Z);
+    axpby(1, Z, zzNew / zz, P);
+    zz = zzNew;
+    res.residual = std::sqrt(dot(R, R)) / bnorm;
+  }
+  res.converged = res.residual <= tol;
+  return res;
+}
+
+/**
+ * Solve A * x = b with BiCGSTAB through dense_operator_t, for the
+ * differential test
+ */
+void bicgstabSolve(matrix_t &A, vector_t &B, vector_t &X) {
+  int n = A.getSize();
+  for (int i = 0; i < n; ++i)
+    X[i] = 0;
+  bicgstab(dense_operator_t(A), B, X, 1e-15, 10 * n + 100);
+}
+
+/**
+ * sparse_matrix_t is a square sparse matrix in compressed sparse row form:
+ * the entries of row i are (col[k], val[k]) for k in [rowptr[i],
+ * rowptr[i + 1]), in increasing column order
+ */
+struct sparse_matrix_t : public linear_operator_t {
+  int n = 0;
+  std::vector<int> rowptr, col;
+  std::vector<double> val;
+
+  unsigned int getSize() const { return n; }
+  void apply(const vector_t &X, vector_t &Y) const {
+    parallel_for(blocked_range<int>(0, n, tiling().strip),
+                 [&](const blocked_range<int> &r) {
+                   for (int i = r.begin(); i != r.end(); ++i) {
+                     double v = 0;
+                     for (int k = rowptr[i]; k < rowptr[i + 1]; ++k)
+                       v += val[k] * X[col[k]];
+                     Y[i] = v;
+                   }
+                 });
+  }
+  void applyTranspose(const vector_t &X, vector_t &Y) const {
+    for (int i = 0; i < n; ++i)
+      Y[i] = 0;
+    for (int i = 0; i < n; ++i)
+      for (int k = rowptr[i]; k < rowptr[i + 1]; ++k)
+        Y[col[k]] += val[k] * X[i];
+  }
+  void diagonal(vector_t &D) const {
+    for (int i = 0; i < n; ++i) {
+      D[i] = 0;
+      for (int k = rowptr[i]; k < rowptr[i + 1]; ++k)
+        if (col[k] == i)
+          D[i] = val[k];
+    }
+  }
+};
+
+/**
+ * sparse_lu_t factors sparse matrices that share one pattern, without
+ * pivoting, as time stepping and Newton iterations produce them.  All of
+ * the work that depends only on the pattern is done once, by the
+ * constructor: a nested dissection ordering of the pattern of A + A^T,
+ * its elimination tree, the fill pattern of L and U, the levels of the tree
+ * that can be factored in parallel, where each entry of A goes, and the
+ * storage of the factors.  factor() then only moves numbers: it walks no
+ * graph, and allocates nothing but each thread's work column, on its first
+ * call.
+ *
+ * The pattern is symmetrized, so U right of the diagonal has the pattern of
+ * L below it, transposed.  Without pivoting, the matrices must not need it,
+ * e.g. be diagonally dominant.
+ */
+class sparse_lu_t {
+  int n;
+
+  /** the ordering: new index i is old index perm[i], and back */
+  std::vector<int> perm, iperm;
+
+  /** the elimination tree: the parent of each column, or -1 at a root */
+  std::vector<int> parent;
+
+  /**
+   * The columns of level l of the tree are levcols[levptr[l]] up to
+   * levcols[levptr[l + 1]].  A column depends only on its descendants, so
+   * a level depends only on the ones before it.
+   */
+  std::vector<int> levptr, levcols;
+
+  /** Column j of the ordered A: rows acolrow[k], values val[acolsrc[k]] */
+  std::vector<int> acolptr, acolrow, acolsrc;
+
+  /** L below the diagonal and U above it, by columns, rows increasing */
+  std::vector<int> lptr, lrow, uptr, urow;
+  std::vector<double> lval, uval, diag;
+
+  /** a dense column per thread, all zero between columns */
+  tbb::enumerable_thread_specific<std::vector<double>> work;
+
+public:
+  explicit sparse_lu_t(const sparse_matrix_t &A)
+      : n(A.n), perm(n), iperm(n), parent(n, -1), work(std::vector<double>(n)) {
+    // The graph of A + A^T, without the diagonal
+    std::vector<std::vector<int>> adj(n);
+    for (int i = 0; i < n; ++i)
+      for (int k = A.rowptr[i]; k < A.rowptr[i + 1]; ++k)
+        if (A.col[k] != i) {
+          adj[i].push_back(A.col[k]);
+          adj[A.col[k]].push_back(i);
+        }
+    for (auto &a : adj) {
+      std::sort(a.begin(), a.end());
+      a.erase(std::unique(a.begin(), a.end()), a.end());
+    }
+
+    // Nested dissection, in George's automatic form: split each part of
+    // the graph at the middle level of a breadth-first search from a far
+    // node, order the pieces first, each the same way, and the separator
+    // last.  owner[v] is the part v is in, or -1 once v is ordered
+    std::vector<int> owner(n, 0), level(n);
+    int parts = 0, next = 0;
+    // breadth first from v through its part, which becomes part id
+    auto bfs = [&](int v, int id, std::vector<int> &order) {
+      int from = owner[v];
+      order.assign(1, v);
+      owner[v] = id;
+      level[v] = 0;
+      for (std::size_t h = 0; h < order.size(); ++h)
+        for (int w : adj[order[h]])
+          if (owner[w] == from) {
+            owner[w] = id;
+            level[w] = level[order[h]] + 1;
+            order.push_back(w);
+          }
+    };
+    std::function<void(int)> dissect = [&](int v) {
+      std::vector<int> order;
+      bfs(v, ++parts, order);
+      if (order.size() > 64)
+        bfs(order.back(), ++parts, order);
+      int levels = level[order.back()] + 1, id = parts;
+      if (order.size() <= 64 || levels < 3) {
+        for (int w : order) {
+          perm[next++] = w;
+          owner[w] = -1;
+        }
+        return;
+      }
+      std::vector<int> separator;
+      for (int w : order)
+        if (level[w] == levels / 2) {
+          separator.push_back(w);
+          owner[w] = -1;
+        }
+      for (int w : order)
+        if (owner[w] == id)
+          dissect(w);
+      for (int w : separator)
+        perm[next++] = w;
+    };
+    for (int v = 0; v < n; ++v)
+      if (owner[v] == 0)
+        dissect(v);
+    for (int i = 0; i < n; ++i)
+      iperm[perm[i]] = i;
+
+    // The ordered graph, lower neighbours only
+    std::vector<std::vector<int>> lower(n);
+    for (int i = 0; i < n; ++i)
+      for (int w : adj[perm[i]])
+        if (iperm[w] < i)
+          lower[i].push_back(iperm[w]);
+
+    // The elimination tree, with path compression (Liu)
+    std::vector<int> ancestor(n, -1);
+    for (int i = 0; i < n; ++i)
+      for (int k : lower[i])
+        for (int r = k; r != i;) {
+          int a = ancestor[r];
+          ancestor[r] = i;
+          if (a == -1) {
+            parent[r] = i;
+            break;
+          }
+          r = a;
+        }
+
+    // The pattern of row i of L is the union of the paths up the tree from
+    // its nonzeros to i; it is also the pattern of column i of U
+    std::vector<int> mark(n, -1), lcount(n);
+    uptr.assign(n + 1, 0);
+    for (int i = 0; i < n; ++i) {
+      mark[i] = i;
+      std::size_t from = urow.size();
+      for (int k : lower[i])
+        for (int j = k; mark[j] != i; j = parent[j]) {
+          mark[j] = i;
+          urow.push_back(j);
+          ++lcount[j];
+        }
+      std::sort(urow.begin() + from, urow.end());
+      uptr[i + 1] = urow.size();
+    }
+    lptr.assign(n + 1, 0);
+    for (int j = 0; j < n; ++j)
+      lptr[j + 1] = lptr[j] + lcount[j];
+    lrow.resize(lptr[n]);
+    std::vector<int> fill(lptr.begin(), lptr.end() - 1);
+    for (int i = 0; i < n; ++i)
+      for (int p = uptr[i]; p < uptr[i + 1]; ++p)
+        lrow[fill[urow[p]]++] = i;
+
+    // Levels: the height of each column above the leaves
+    std::vector<int> height(n);
+    int levels = 0;
+    for (int j = 0; j < n; ++j) {
+      levels = std::max(levels, height[j] + 1);
+      if (parent[j] >= 0)
+        height[parent[j]] = std::max(height[parent[j]], height[j] + 1);
+    }
+    levptr.assign(levels + 1, 0);
+    for (int j = 0; j < n; ++j)
+      ++levptr[height[j] + 1];
+    for (int l = 0; l < levels; ++l)
+      levptr[l + 1] += levptr[l];
+    levcols.resize(n);
+    fill.assign(levptr.begin(), levptr.end() - 1);
+    for (int j = 0; j < n; ++j)
+      levcols[fill[height[j]]++] = j;
+
+    // Where each entry of A goes: its ordered column, and row
+    acolptr.assign(n + 1, 0);
+    for (int k = 0; k < A.rowptr[n]; ++k)
+      ++acolptr[iperm[A.col[k]] + 1];
+    for (int j = 0; j < n; ++j)
+      acolptr[j + 1] += acolptr[j];
+    acolrow.resize(A.rowptr[n]);
+    acolsrc.resize(A.rowptr[n]);
+    fill.assign(acolptr.begin(), acolptr.end() - 1);
+    for (int i = 0; i < n; ++i)
+      for (int k = A.rowptr[i]; k < A.rowptr[i + 1]; ++k) {
+        int p = fill[iperm[A.col[k]]]++;
+        acolrow[p] = iperm[i];
+        acolsrc[p] = k;
+      }
+
+    lval.resize(lrow.size());
+    uval.resize(urow.size());
+    diag.resize(n);
+  }
+
+  /**
+   * Factor A, which must have the pattern this was made for, into the
+   * storage prepared for it.  Each column is computed left-looking, from
+   * the finished columns of its descendants, in a dense work column; the
+   * columns of a level are computed in parallel.  Returns false if a pivot
+   * is zero.
+   */
+  bool factor(const sparse_matrix_t &A) {
+    std::atomic<bool> ok(true);
+    auto column = [&](int j) {
+      std::vector<double> &x = work.local();
+      for (int p = acolptr[j]; p < acolptr[j + 1]; ++p)
+        x[acolrow[p]] = A.val[acolsrc[p]];
+      for (int p = uptr[j]; p < uptr[j + 1]; ++p) {
+        int k = urow[p];
+        double u = uval[p] = x[k];
+        for (int q = lptr[k]; q < lptr[k + 1]; ++q)
+          x[lrow[q]] -= lval[q] * u;
+      }
+      double d = diag[j] = x[j];
+      if (d == 0.0)
+        ok = false;
+      for (int p = lptr[j]; p < lptr[j + 1]; ++p)
+        lval[p] = x[lrow[p]] / d;
+      for (int p = uptr[j]; p < uptr[j + 1]; ++p)
+        x[urow[p]] = 0;
+      for (int p = lptr[j]; p < lptr[j + 1]; ++p)
+        x[lrow[p]] = 0;
+      x[j] = 0;
+    };
+    for (int l = 0; l + 1 < (int)levptr.size(); ++l) {
+      int b = levptr[l], e = levptr[l + 1];
+      if (e - b == 1)
+        column(levcols[b]);
+      else
+        parallel_for(blocked_range<int>(b, e),
+                     [&](const blocked_range<int> &r) {
+                       for (int c = r.begin(); c != r.end(); ++c)
+                         column(levcols[c]);
+                     });
+    }
+    return ok;
+  }
+
+  /**
+   * Solve A * x = b with the factors.  The scratch belongs to the call, so
+   * many threads can solve with one factorization at once.
+   */
+  void solve(const vector_t &B, vector_t &X) const {
+    std::vector<double> y(n);
+    for (int i = 0; i < n; ++i)
+      y[i] = B[perm[i]];
+    for (int j = 0; j < n; ++j)
+      for (int p = lptr[j]; p < lptr[j + 1]; ++p)
+        y[lrow[p]] -= lval[p] * y[j];
+    for (int j = n - 1; j >= 0; --j) {
+      y[j] /= diag[j];
+      for (int p = uptr[j]; p < uptr[j + 1]; ++p)
+        y[urow[p]] -= uval[p] * y[j];
+    }
+    for (int i = 0; i < n; ++i)
+      X[perm[i]] = y[i];
+  }
+
+  /** The nonzeros of L and U, with the diagonal */
+  std::size_t factorEntries() const { return lrow.size() + urow.size() + n; }
+
+  /** The levels of the elimination tree */
+  int levels() const { return levptr.size() - 1; }
+};
+
+/**
+ * Make A the matrix of one implicit time step of a convection-diffusion
+ * problem on an m x m grid: I + dt * (a five-point operator with the
+ * diffusivity kappa of each cell, and some flow to the east).  The pattern
+ * is the same for every dt and kappa, so only the values change once A has
+ * been made.
+ */
+void timeStepMatrix(sparse_matrix_t &A, int m, double dt,
+                    const std::vector<double> &kappa) {
+  bool fresh = A.n == 0;
+  A.n = m * m;
+  if (fresh)
+    A.rowptr.assign(1, 0);
+  A.val.clear();
+  for (int i = 0; i < A.n; ++i) {
+    int x = i % m, y = i / m;
+    double center = 1;
+    auto entry = [&](int j, double w) {
+      double k = dt * (kappa[i] + kappa[j]) / 2;
+      center += 2 * k;
+      if (fresh)
+        A.col.push_back(j);
+      A.val.push_back(-k * w);
+    };
+    // in increasing column order, with the center's place kept
+    if (y > 0)
+      entry(i - m, 1);
+    if (x > 0)
+      entry(i - 1, 1.3);
+    std::size_t c = A.val.size();
+    if (fresh)
+      A.col.push_back(i);
+    A.val.push_back(0);
+    if (x < m - 1)
+      entry(i + 1, 0.7);
+    if (y < m - 1)
+      entry(i + m, 1);
+    A.val[c] = center;
+    if (fresh)
+      A.rowptr.push_back(A.col.size());
+  }
+}
+
+/**
+ * Make sure that the values in X actually satisfy the equation A * x = b,
+ * for the system that source makes (or A^T * x = b, with transpose set)
+ *
+ * Unfortunately, this check isn't so simple.  Even with double precision
+ * floating point, we lose some significant digits, and thus a naive check
+ * won't pass.  So the backward error has to be within tolerance.  The rows
+ * of A are made again as they are needed (see verifyRows()), so A can still
+ * hold the factors.
+ */
+void check(const row_source_t &source, std::size_t n, const vector_t &X,
+           double tolerance, bool transpose = false) {
+  verification_t v = verifyRows(source, n, X, transpose);
+  if (!(v.backwardError <= tolerance)) {
+    std::cout << "Verification failed for index = " << v.worst << "."
+              << std::endl;
+    std::cout << v.ans << " != " << v.b << " (backward error "
+              << v.backwardError << ")" << std::endl;
+    return;
+  }
+  std::cout << "Verification succeeded" << std::endl;
+}
+
+/**
+ * solver_t names one way of solving A * x = b, so that every variant can be
+ * benchmarked and cross-checked the same way.  Like gauss(), a solver may
+ * overwrite A and B.
+ */
+struct solver_t {
+  /** the name used on the command line and in reports */
+  const char *name;
+
+  /** unit roundoff of the arithmetic the solver is expected to deliver */
+  double eps;
+
+  /** solve A * x = b, leaving the answer in X */
+  std::function<void(matrix_t &, vector_t &, vector_t &)> solve;
+
+  /**
+   * the test families (space-separated) the solver is meant for, or null
+   * if it handles any nonsingular matrix
+   */
+  const char *families = nullptr;
+
+  /**
+   * solve as solve() does, but leave the LU factors in A and the
+   * interchanges in piv, for more solves with them (as luSolveTranspose()
+   * does); null if the solver has no such factors
+   */
+  std::function<void(matrix_t &, vector_t &, vector_t &, std::vector<int> &)>
+      keepFactors;
+
+  /** does solve() solve A^T * x = b instead? */
+  bool transposed = false;
+
+  /** Is the solver meant for systems of the given family? */
+  bool handles(const std::string &family) const {
+    return !families || (" " + std::string(families) + " ")
+                                .find(" " + family + " ") != std::string::npos;
+  }
+};
+
+/** The list of every solver variant we know about */
+std::vector<solver_t> &solvers() {
+  static std::vector<solver_t> all = {
+      {"gauss", DBL_EPSILON / 2, gauss, nullptr, gaussKeepingPivots},
+      {"crout", DBL_EPSILON / 2, croutSolve, nullptr, croutKeepingPivots},
+      {"transpose", DBL_EPSILON / 2, transposeSolve, nullptr, nullptr, true},
+      {"adaptive", DBL_EPSILON / 2, adaptiveSolve},
+      {"rbt", DBL_EPSILON / 2, rbtSolve},
+      {"static", DBL_EPSILON / 2, staticSolve},
+      {"tiled", DBL_EPSILON / 2, tiledSolve},
+      {"fp16", DBL_EPSILON / 2, halfSolve<half_t>},
+      {"bf16", DBL_EPSILON / 2, halfSolve<bfloat16_t>},
+      // HODLR never pivots between blocks, so it is only stable when the
+      // diagonal blocks are well-conditioned
+      {"hodlr", DBL_EPSILON / 2, hodlrSolve, "diagdom kernel"},
+      // Krylov methods need a well-conditioned matrix to converge
+      {"bicgstab", DBL_EPSILON / 2, bicgstabSolve, "diagdom kernel"},
+#ifdef GAUSS_WITH_LAPACK
+      {"lapack", DBL_EPSILON / 2, lapackSolve},
+#endif
+  };
+  return all;
+}
+
+/**
+ * Solve A * x = b with plain serial partial pivoting in extended precision.
+ * This is the yardstick the differential test holds every variant against,
+ * so it deliberately shares no code with them.
+ */
+std::vector<long double> referenceSolve(const matrix_t &A, const vector_t &B) {
+  int n = A.getSize();
+  std::vector<std::vector<long double>> M(n, std::vector<long double>(n + 1));
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j)
+      M[i][j] = A[i][j];
+    M[i][n] = B[i];
+  }
+  for (int i = 0; i < n; ++i) {
+    int row = i;
+    for (int k = i + 1; k < n; ++k)
+      if (std::fabs(M[k][i]) > std::fabs(M[row][i]))
+        row = k;
+    std::swap(M[i], M[row]);
+    for (int k = i + 1; k < n; ++k) {
+      long double c = M[k][i] / M[i][i];
+      for (int j = i; j <= n; ++j)
+        M[k][j] -= c * M[i][j];
+    }
+  }
+  std::vector<long double> x(n);
+  for (int i = n - 1; i >= 0; --i) {
+    long double s = M[i][n];
+    for (int j = i + 1; j < n; ++j)
+      s -= M[i][j] * x[j];
+    x[i] = s / M[i][i];
+  }
+  return x;
+}
+
+/**
+ * Compute the normwise backward error of X as a solution of A * x = b:
+ * ||b - Ax|| / (||A|| ||x|| + ||b||), in the infinity norm.  Unlike the
+ * forward error, this is small for any backward-stable solver no matter how
+ * ill-conditioned A is.
+ */
+template <typename T>
+double backwardError(const matrix_t &A, const vector_t &B, const T &X) {
+  int n = A.getSize();
+  long double rnorm = 0, anorm = 0, xnorm = 0, bnorm = 0;
+  for (int i = 0; i < n; ++i) {
+    long double r = B[i], a = 0;
+    for (int j = 0; j < n; ++j) {
+      r -= (long double)A[i][j] * X[j];
+      a += std::fabs(A[i][j]);
+    }
+    rnorm = std::max(rnorm, std::fabs(r));
+    anorm = std::max(anorm, a);
+    xnorm = std::max(xnorm, (long double)std::fabs(X[i]));
+    bnorm = std::max(bnorm, (long double)std::fabs(B[i]));
+  }
+  return (double)(rnorm / (anorm * xnorm + bnorm));
+}
 
-  /** the # rows / # columns / sqrt(# elements) */
-  unsigned int size;
+/** The matrix families the differential test draws its systems from */
+const char *const testFamilies[] = {"uniform", "diagdom", "graded", "hilbert",
+                                    "permuted-triangular", "kernel"};
 
-public:
-  /** Construct by allocating the matrix */
-  matrix_t(unsigned int n) : size(n), M(new double *[n]) {
-    for (int i = 0; i < size; ++i)
-      M[i] = new double[size];
+/**
+ * Populate A and B with a member of the given family.  Every family starts
+ * from initializeFromSeed(), so a (family, seed, n) triple names a system.
+ */
+void initializeFamily(const std::string &family, int seed, matrix_t &A,
+                      vector_t &B) {
+  int n = A.getSize();
+  initializeFromSeed(seed, A, B, 65536);
+  if (family == "diagdom") {
+    // strictly diagonally dominant: no row swaps should ever be needed
+    for (int i = 0; i < n; ++i) {
+      double sum = 0;
+      for (int j = 0; j < n; ++j)
+        sum += abs(A[i][j]);
+      A[i][i] = A[i][i] < 0 ? -sum - 1 : sum + 1;
+    }
+  } else if (family == "graded") {
+    // row scales spanning many orders of magnitude stress the pivot choice
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+        A[i][j] = std::ldexp(A[i][j], (i * 7) % 41 - 20);
+  } else if (family == "hilbert") {
+    // notoriously ill-conditioned, but still symmetric positive definite
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+        A[i][j] = 1.0 / (i + j + 1);
+  } else if (family == "kernel") {
+    // a smooth-kernel integral equation, with low-rank off-diagonal blocks
+    kernel_system_t K(seed, n);
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+        A[i][j] = K(i, j);
+  } else if (family == "permuted-triangular") {
+    // an upper triangular matrix with shuffled rows: every step must swap,
+    // and most candidate pivots are exact zeros
+    std::vector<int> perm(n);
+    for (int i = 0; i < n; ++i)
+      perm[i] = i;
+    std::shuffle(perm.begin(), perm.end(), std::mt19937(seed));
+    for (int i = 0; i < n; ++i)
+      for (int j = 0; j < n; ++j)
+        if (j < perm[i])
+          A[i][j] = 0;
+        else if (j == perm[i])
+          A[i][j] = 1 + (i % 5);
   }
-  /** Give the illusion of this being a simple array */
-  double *&operator[](std::size_t idx) { return M[idx]; };
-  double *const &operator[](std::size_t idx) const { return M[idx]; };
-  unsigned int getSize() { return size; }
-};
+}
 
 /**
- * vector_t represents a 1-d array of doubles
+ * Run every solver variant over many seeds, sizes and matrix families, and
+ * compare each answer against referenceSolve().  A variant fails when its
+ * backward error exceeds a modest multiple of n times its unit roundoff.
+ * Returns the number of failures.
  */
-class vector_t {
-  /** simple array of doubles */
-  double *V;
+int differentialTest(int seeds) {
+  // sizes include the trivial ones, primes, powers of two, and values just
+  // off a multiple of any plausible SIMD width or tile size
+  const int sizes[] = {1, 2, 3, 4, 5, 7, 8, 13, 16, 17, 31, 33, 64, 97, 128, 257};
+  int cases = 0, failures = 0;
+  for (auto &family : testFamilies) {
+    for (int n : sizes) {
+      for (int seed = 0; seed < seeds; ++seed) {
+        matrix_t A(n);
+        vector_t B(n);
+        initializeFamily(family, 411 + seed, A, B);
+        std::vector<long double> ref = referenceSolve(A, B);
 
-  /** size of V */
-  unsigned int size;
+        // the transposed system, for the solvers that solve A^T * x = b
+        matrix_t AT(n);
+        for (int i = 0; i < n; ++i)
+          for (int j = 0; j < n; ++j)
+            AT[j][i] = A[i][j];
+        std::vector<long double> refT = referenceSolve(AT, B);
+        for (auto &s : solvers()) {
+          if (!s.handles(family))
+            continue;
+          matrix_t A2(A);
+          vector_t B2(B);
+          vector_t X(n);
+          ++cases;
+          try {
+            s.solve(A2, B2, X);
+          } catch (const singular_matrix_t &) {
+            ++failures;
+            std::cout << "FAIL " << s.name << " family=" << family
+                      << " n=" << n << " seed=" << 411 + seed
+                      << " singular" << std::endl;
+            continue;
+          }
+
+          // the forward difference from the reference is only reported, as
+          // it legitimately scales with the condition number
+          double eta = backwardError(s.transposed ? AT : A, B, X);
+          const std::vector<long double> &r = s.transposed ? refT : ref;
+          long double diff = 0, norm = 0;
+          for (int i = 0; i < n; ++i) {
+            diff = std::max(diff, std::fabs(X[i] - r[i]));
+            norm = std::max(norm, std::fabs(r[i]));
+          }
+          double tolerance = 64.0 * n * s.eps;
+          if (!(eta <= tolerance)) {
+            ++failures;
+            std::cout << "FAIL " << s.name << " family=" << family
+                      << " n=" << n << " seed=" << 411 + seed
+                      << " backward error=" << eta
+                      << " (tolerance " << tolerance << ")"
+                      << " forward difference=" << (double)(diff / norm)
+                      << std::endl;
+          }
+        }
+      }
+    }
+  }
+  std::cout << "Differential test: " << cases << " cases, " << failures
+            << " failures" << std::endl;
+  return failures;
+}
+
+/**
+ * energy_meter_t reads the RAPL energy counters that Linux exposes under
+ * /sys/class/powercap, one per CPU package.  When there are no counters (no
+ * RAPL, a VM, or no permission to read them), available() is false and
+ * every measurement is zero, so callers can skip reporting.
+ */
+class energy_meter_t {
+  /** the energy_uj file of each package zone */
+  std::vector<std::string> counters;
+
+  /** the value at which each counter wraps back to zero, in microjoules */
+  std::vector<double> ranges;
+
+  /** Read one sysfs value, or return -1 if it cannot be read */
+  static double readValue(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+      return -1;
+    double v = -1;
+    if (fscanf(f, "%lf", &v) != 1)
+      v = -1;
+    fclose(f);
+    return v;
+  }
 
 public:
-  /** Construct by allocating the vector */
-  vector_t(unsigned int n) : size(n), V(new double[n]) {}
-  /** Give the illusion of this being a simple array */
-  double &operator[](std::size_t idx) { return V[idx]; };
-  const double &operator[](std::size_t idx) const { return V[idx]; };
-  unsigned int getSize() { return size; }
+  /** Discover the package-level zones, skipping their sub-zones */
+  energy_meter_t() {
+    const std::string root = "/sys/class/powercap/";
+    DIR *dir = opendir(root.c_str());
+    if (!dir)
+      return;
+    while (dirent *e = readdir(dir)) {
+      std::string name = e->d_name;
+      // "intel-rapl:0" is a package; "intel-rapl:0:1" is a part of one
+      if (name.compare(0, 11, "intel-rapl:") != 0 ||
+          name.find(':', 11) != std::string::npos)
+        continue;
+      std::string path = root + name + "/energy_uj";
+      double range = readValue(root + name + "/max_energy_range_uj");
+      if (readValue(path) < 0 || range <= 0)
+        continue;
+      counters.push_back(path);
+      ranges.push_back(range);
+    }
+    closedir(dir);
+  }
+
+  /** Are there any counters to read? */
+  bool available() const { return !counters.empty(); }
+
+  /** Take a snapshot of every counter */
+  std::vector<double> sample() const {
+    std::vector<double> s;
+    for (auto &c : counters)
+      s.push_back(readValue(c));
+    return s;
+  }
+
+  /** The joules consumed between two snapshots, allowing for wraparound */
+  double joules(const std::vector<double> &start,
+                const std::vector<double> &end) const {
+    double uj = 0;
+    for (std::size_t i = 0; i < start.size() && i < end.size(); ++i) {
+      if (start[i] < 0 || end[i] < 0)
+        continue;
+      uj += end[i] >= start[i] ? end[i] - start[i]
+                               : ranges[i] - start[i] + end[i];
+    }
+    return uj / 1e6;
+  }
+};
+
+/** The floating point operations of one LU solve of an n x n system */
+double solveFlops(double n) { return 2.0 * n * n * n / 3.0 + 2.0 * n * n; }
+
+/** Summary statistics of repeated timing trials, in seconds */
+struct timing_stats_t {
+  double min, median, mean, stddev;
+
+  /** half-width of the 95% confidence interval of the mean */
+  double ci95;
 };
 
+/** Summarize a set of trial times */
+timing_stats_t summarize(std::vector<double> times) {
+  // two-sided 95% quantiles of Student's t, for 1 to 30 degrees of freedom
+  static const double t95[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+                               2.365,  2.306, 2.262, 2.228, 2.201, 2.179,
+                               2.160,  2.145, 2.131, 2.120, 2.110, 2.101,
+                               2.093,  2.086, 2.080, 2.074, 2.069, 2.064,
+                               2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+  timing_stats_t s;
+  int n = times.size();
+  std::sort(times.begin(), times.end());
+  s.min = times[0];
+  s.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+  s.mean = 0;
+  for (double t : times)
+    s.mean += t / n;
+  double ss = 0;
+  for (double t : times)
+    ss += (t - s.mean) * (t - s.mean);
+  s.stddev = n > 1 ? std::sqrt(ss / (n - 1)) : 0;
+  s.ci95 = n > 1 ? (n - 1 <= 30 ? t95[n - 2] : 1.96) * s.stddev / std::sqrt(n)
+                 : 0;
+  return s;
+}
+
 /**
- * Given a random seed, populate the elements of A and then B with a
- * sequence of random numbers in the range (-range...range)
+ * Solve the smooth-kernel system of size n from kernel_system_t with the
+ * HODLR solver, which never forms the n x n matrix, and report the time of
+ * each phase.  The check recomputes a sample of rows of A * x = b exactly.
  */
-void initializeFromSeed(int seed, matrix_t &A, vector_t &B,
-                        unsigned int range) {
-  // Use a Mersenne Twister to create doubles in the requested range
-  std::mt19937 seeder(seed);
-  auto mt_rand =
-      std::bind(std::uniform_real_distribution<double>(-range, range),
-                std::mt19937(seed));
-  // populate A
-  for (int i = 0; i < A.getSize(); ++i)
-    for (int j = 0; j < A.getSize(); ++j)
-      A[i][j] = (double)(mt_rand());
-  // populate B
-  for (int i = 0; i < B.getSize(); ++i)
-    B[i] = (double)(mt_rand());
-}
-
-/** Print the matrix and array in a form that looks good */
-void print(matrix_t &A, vector_t &B) {
-  for (int i = 0; i < A.getSize(); ++i) {
-    for (int j = 0; j < A.getSize(); ++j)
-      std::cout << A[i][j] << "\t";
-    std::cout << " | " << B[i] << "\n";
+void kernelBenchmark(int seed, int n, bool docheck) {
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  using std::chrono::high_resolution_clock;
+
+  kernel_system_t K(seed, n);
+  vector_t B(n), X(n);
+  std::mt19937 mt(seed + 1);
+  std::uniform_real_distribution<double> u(-1, 1);
+  for (int i = 0; i < n; ++i)
+    B[i] = u(mt);
+
+  auto t0 = high_resolution_clock::now();
+  hodlr_t H(K, n);
+  auto t1 = high_resolution_clock::now();
+  if (!H.factor()) {
+    std::cout << "The matrix is singular!" << std::endl;
+    exit(-1);
   }
-  std::cout << std::endl;
+  auto t2 = high_resolution_clock::now();
+  H.solve(B, X);
+  auto t3 = high_resolution_clock::now();
+
+  if (docheck) {
+    // every row costs O(n), so check an evenly spaced sample of them
+    int samples = std::min(n, 256);
+    double worst = parallel_reduce(
+        blocked_range<int>(0, samples), 0.0,
+        [&](const blocked_range<int> &r, double w) {
+          for (int s = r.begin(); s != r.end(); ++s) {
+            int i = (long)s * n / samples;
+            double ans = 0;
+            for (int j = 0; j < n; ++j)
+              ans += K(i, j) * X[j];
+            w = std::max(w, abs(ans - B[i]) / abs(B[i]));
+          }
+          return w;
+        },
+        [](double a, double b) { return std::max(a, b); });
+    if (worst < 1e-8)
+      std::cout << "Verification succeeded" << std::endl;
+    else
+      std::cout << "Verification failed: relative residual " << worst
+                << std::endl;
+  }
+  auto secs = [](high_resolution_clock::time_point a,
+                 high_resolution_clock::time_point b) {
+    return duration_cast<duration<double>>(b - a).count();
+  };
+  std::cout << "HODLR max rank " << H.maxRank() << ", storage "
+            << H.bytes() / 1048576.0 << " MiB (dense would be "
+            << (double)n * n * sizeof(double) / 1048576.0 << " MiB)"
+            << std::endl;
+  std::cout << "HODLR time (compress, factor, solve): " << secs(t0, t1)
+            << ", " << secs(t1, t2) << ", " << secs(t2, t3) << " seconds"
+            << std::endl;
+  std::cout << "Total execution time: " << secs(t0, t3) << " seconds"
+            << std::endl;
 }
 
 /**
- * For a system of equations A * x = b, with Matrix A and Vectors B and X,
- * and assuming we only know A and b, compute x via the Gaussian Elimination
- * technique
+ * Solve a sequence of count systems whose matrices drift: each is the one
+ * before with every entry scaled by a random factor within 1 +- drift.
+ * Each is solved twice, with gauss() and with staticSolve(), so the report
+ * shows what reusing the pivot sequence saves, and how often it holds.
  */
-void gauss(matrix_t &A, vector_t &B, vector_t &X) {
-  // iterate over rows
-  for (int i = 0; i < A.getSize(); ++i) {
-    // NB: we are now on the ith column
+void driftBenchmark(int seed, int n, int count, double drift, bool docheck) {
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  using std::chrono::high_resolution_clock;
+  auto secs = [](high_resolution_clock::time_point a,
+                 high_resolution_clock::time_point b) {
+    return duration_cast<duration<double>>(b - a).count();
+  };
 
-    // For numerical stability, find the largest value in this column
-    double big = abs(A[i][i]);
-    int row = i;
-    
-    
-    
-    
-    parallel_reduce(
-    blocked_range<int>(i+1,int(A.getSize()),2),
-    0.0,
-    [&](blocked_range<int> &r, int row){
-    for (int k = r.begin(); k !=r.end(); ++k) {
-      if (abs(A[k][i]) > big) {
-        big = abs(A[k][i]);
-        row = k;
-        
-      }
-    }
-    return row;},
-    [&](int a,int b)->int{
-    if(abs(A[a][i])>abs(A[b][i])){
-    return a;}
+  matrix_t A(n);
+  vector_t B(n), X(n), R(n);
+  initializeFromSeed(seed, A, B, 65536);
+  std::mt19937 mt(seed + 1);
+  std::uniform_real_distribution<double> u(-drift, drift);
+  pivotRecord().piv.clear();
+  double pivoting = 0, reusing = 0, worst = 0;
+  int reused = 0;
+  for (int k = 0; k < count; ++k) {
+    if (k > 0)
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+          A[i][j] *= 1 + u(mt);
+
+    matrix_t F(A);
+    vector_t C(B);
+    auto t0 = high_resolution_clock::now();
+    gauss(F, C, X);
+    auto t1 = high_resolution_clock::now();
+    matrix_t S(A);
+    vector_t D(B);
+    auto t2 = high_resolution_clock::now();
+    staticSolve(S, D, X);
+    auto t3 = high_resolution_clock::now();
+
+    const pivot_record_t &record = pivotRecord();
+    std::cout << "  matrix " << k << ": gauss " << secs(t0, t1)
+              << " s, static " << secs(t2, t3) << " s";
+    if (!record.reused)
+      std::cout << ", recorded the pivots";
+    else if (record.pivotFrom >= 0)
+      std::cout << ", pivoted again from step " << record.pivotFrom;
     else
-    return b;
+      std::cout << ", reused the pivots";
+    if (docheck) {
+      double eta = residual(A, B, X, R);
+      worst = std::max(worst, eta);
+      std::cout << ", backward error " << eta;
     }
-    );
-    // Given our random initialization, singular matrices are possible!
-    if (big == 0.0) {
+    std::cout << std::endl;
+    if (k > 0) {
+      pivoting += secs(t0, t1);
+      reusing += secs(t2, t3);
+      reused += record.pivotFrom < 0;
+    }
+  }
+  if (count > 1)
+    std::cout << "Refactorization: reused the pivots " << reused << " of "
+              << count - 1 << " times, " << pivoting / reusing
+              << "x the speed of pivoting" << std::endl;
+  if (docheck) {
+    if (worst < 64 * n * DBL_EPSILON)
+      std::cout << "Verification succeeded" << std::endl;
+    else
+      std::cout << "Verification failed: backward error " << worst
+                << std::endl;
+  }
+}
+
+/**
+ * Take steps implicit time steps of a convection-diffusion problem on a
+ * grid of about n points, with a time step and diffusivities that change at
+ * every step, so every step needs a new factorization of a matrix with the
+ * same pattern.  The symbolic analysis is done once; the report compares
+ * its cost with that of each numeric factorization.
+ */
+void sparseBenchmark(int seed, int n, int steps, bool docheck) {
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  using std::chrono::high_resolution_clock;
+  auto secs = [](high_resolution_clock::time_point a,
+                 high_resolution_clock::time_point b) {
+    return duration_cast<duration<double>>(b - a).count();
+  };
+
+  int m = std::max(1, (int)std::lround(std::sqrt((double)n)));
+  n = m * m;
+  std::mt19937 mt(seed);
+  std::uniform_real_distribution<double> u(-1, 1);
+  std::vector<double> kappa(n);
+  vector_t U(n), X(n), R(n);
+  for (int i = 0; i < n; ++i) {
+    kappa[i] = 1 + u(mt) / 2;
+    U[i] = u(mt);
+  }
+  sparse_matrix_t A;
+  timeStepMatrix(A, m, 0.1, kappa);
+
+  auto t0 = high_resolution_clock::now();
+  sparse_lu_t lu(A);
+  auto t1 = high_resolution_clock::now();
+  double numeric = 0, solving = 0, worst = 0;
+  for (int s = 0; s < steps; ++s) {
+    for (int i = 0; i < n; ++i)
+      kappa[i] *= 1 + u(mt) / 100;
+    timeStepMatrix(A, m, 0.1 * (1 + std::sin(s) / 2), kappa);
+    auto t2 = high_resolution_clock::now();
+    if (!lu.factor(A)) {
       std::cout << "The matrix is singular!" << std::endl;
       exit(-1);
     }
+    auto t3 = high_resolution_clock::now();
+    lu.solve(U, X);
+    auto t4 = high_resolution_clock::now();
+    numeric += secs(t2, t3);
+    solving += secs(t3, t4);
+    if (docheck) {
+      A.apply(X, R);
+      axpby(1, U, -1, R);
+      worst = std::max(worst, std::sqrt(dot(R, R) / dot(U, U)));
+    }
+    for (int i = 0; i < n; ++i)
+      U[i] = X[i];
+  }
+
+  std::cout << "Sparse LU of " << n << " unknowns, " << A.rowptr[n]
+            << " entries: " << lu.factorEntries()
+            << " in the factors, tree of " << lu.levels() << " levels"
+            << std::endl;
+  std::cout << "Symbolic analysis (once): " << secs(t0, t1)
+            << " seconds; numeric factorization (per step): "
+            << numeric / std::max(1, steps) << " seconds; solve (per step): "
+            << solving / std::max(1, steps) << " seconds" << std::endl;
+  if (docheck) {
+    if (worst < 1e-12)
+      std::cout << "Verification succeeded" << std::endl;
+    else
+      std::cout << "Verification failed: relative residual " << worst
+                << std::endl;
+  }
+  std::cout << "Total execution time: " << secs(t0, t1) + numeric + solving
+            << " seconds" << std::endl;
+}
 
-    // swap so max column value is in ith row
-    std::swap(A[i], A[row]);
-    std::swap(B[i], B[row]);
+/**
+ * Solve a system of about n unknowns given only as a built-in matrix-free
+ * operator ("poisson", "convdiff" or "convolution") with an iterative
+ * method ("bicgstab" or "cgnr"), in O(n) memory
+ */
+void matrixFreeBenchmark(const std::string &op, const std::string &method,
+                         int seed, int n, bool docheck) {
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  using std::chrono::high_resolution_clock;
 
-    // Eliminate the ith row from all subsequent rows
-    //
-    // NB: this will lead to all subsequent rows having a 0 in the ith
-    // column
-    
-    
+  int m = std::max(1, (int)std::lround(std::sqrt((double)n)));
+  std::unique_ptr<linear_operator_t> A;
+  if (op == "poisson")
+    A.reset(new stencil2d_t(m, 4, -1, -1, -1, -1));
+  else if (op == "convdiff")
+    A.reset(new stencil2d_t(m, 4, -1.5, -0.5, -1.2, -0.8));
+  else if (op == "convolution")
+    A.reset(new convolution_t(n, {0.1, 0.25, 1, 0.15, 0.05}));
+  else {
+    std::cout << "Unknown operator: " << op << std::endl;
+    exit(-1);
+  }
+  if (method != "bicgstab" && method != "cgnr") {
+    std::cout << "Unknown iterative method: " << method << std::endl;
+    exit(-1);
+  }
+  n = A->getSize();
+  vector_t B(n), X(n), R(n);
+  std::mt19937 mt(seed);
+  std::uniform_real_distribution<double> u(-1, 1);
+  for (int i = 0; i < n; ++i) {
+    B[i] = u(mt);
+    X[i] = 0;
+  }
 
+  auto starttime = high_resolution_clock::now();
+  iterative_result_t res;
+  if (method == "cgnr")
+    res = cgnr(*A, B, X, 1e-10, 10 * n);
+  else
+    res = bicgstab(*A, B, X, 1e-10, 10 * n);
+  auto endtime = high_resolution_clock::now();
 
-    
-  parallel_for(blocked_range<int>(i+1,int (A.getSize()),2) , [&](blocked_range<int> &r) {
-    for (int k = r.begin(); k !=r.end(); ++k) {
-      double c = -A[k][i] / A[i][i];
-      for (int j = i; j < A.getSize(); ++j)
-        if (i == j)
-          A[k][j] = 0;
-        else
-          A[k][j] += c * A[i][j];
-      B[k] += c * B[i];
-    }
-  });}
+  std::cout << method << " on " << op << " (" << n << " unknowns): "
+            << res.iterations << " iterations, relative residual "
+            << res.residual << std::endl;
+  if (docheck) {
+    // recompute the residual from scratch rather than trust the recurrence
+    A->apply(X, R);
+    axpby(1, B, -1, R);
+    double r = std::sqrt(dot(R, R) / dot(B, B));
+    if (r < 1e-8)
+      std::cout << "Verification succeeded" << std::endl;
+    else
+      std::cout << "Verification failed: relative residual " << r
+                << std::endl;
+  }
+  std::cout << "Total execution time: "
+            << duration_cast<duration<double>>(endtime - starttime).count()
+            << " seconds" << std::endl;
+}
+
+/** solve_job_t is one solve of a throughput run: a system made from a seed */
+struct solve_job_t {
+  int n, seed;
+
+  /** the threads the scheduler gave it */
+  int threads = 0;
+
+  /** seconds spent queued, and solving */
+  double wait = 0, seconds = 0;
+
+  /** the backward error of the answer, or -1 if it wasn't checked */
+  double backwardError = -1;
+
+  /** was it turned away because it can never fit in the memory budget? */
+  bool skipped = false;
+
+  /** did the governor downgrade it to a float matrix? */
+  bool downgraded = false;
+
+  /** did the solver find the matrix singular? */
+  bool singular = false;
+
+  /** the memory in use, and the queue depth, when it started */
+  std::size_t memoryAtStart = 0;
+  int queueAtStart = 0;
+};
+
+/**
+ * Estimate the bytes that one solve of size n needs, with the matrix held
+ * in double or, for a downgraded solve, in float
+ */
+std::size_t solveFootprint(int n, bool reduced = false) {
+  std::size_t matrix =
+      reduced ? (std::size_t)n * basic_matrix_t<float>::paddedStride(n) *
+                    sizeof(float)
+              : (std::size_t)n * matrix_t::paddedStride(n) * sizeof(double);
+  return matrix +
+         (std::size_t)n * (sizeof(double *) + 3 * sizeof(double) + sizeof(int));
+}
+
+/**
+ * memory_governor_t keeps the memory of all the solves in the process
+ * within a budget.  A solve reserves its estimated footprint before it
+ * allocates anything and releases it when it is done, so a burst of large
+ * solves waits (or is downgraded) instead of running the node out of
+ * memory.  It also keeps the current usage and the number of queued
+ * solves, for reporting.
+ */
+class memory_governor_t {
+  std::mutex m;
+  std::size_t budget, used = 0, peak = 0;
+  int queued = 0;
+
+public:
+  /** Start with half of physical memory as the budget */
+  memory_governor_t()
+      : budget((std::size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) /
+               2) {}
+
+  void setBudget(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(m);
+    budget = bytes;
+  }
+  std::size_t getBudget() {
+    std::lock_guard<std::mutex> lock(m);
+    return budget;
+  }
+
+  /** Reserve bytes if they fit in the budget right now */
+  bool tryReserve(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(m);
+    if (used + bytes > budget)
+      return false;
+    used += bytes;
+    peak = std::max(peak, used);
+    return true;
+  }
+
+  /** Give back a reservation */
+  void release(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(m);
+    used -= bytes;
+  }
 
-  // NB: A is now an upper triangular matrix
+  /** Count solves that are waiting for memory, e.g. in a queue */
+  void enqueue(int count = 1) {
+    std::lock_guard<std::mutex> lock(m);
+    queued += count;
+  }
 
-  // Use back substitution to solve equation A * x = b
-  for (int i = A.getSize() - 1; i >= 0; --i) {
-    X[i] = B[i] / A[i][i];
-    for (int k = i - 1; k >= 0; --k)
-      B[k] -= A[k][i] * X[i];
+  std::size_t inUse() {
+    std::lock_guard<std::mutex> lock(m);
+    return used;
+  }
+  std::size_t peakUse() {
+    std::lock_guard<std::mutex> lock(m);
+    return peak;
+  }
+  int queueDepth() {
+    std::lock_guard<std::mutex> lock(m);
+    return queued;
   }
+};
+
+/** The governor of the whole process */
+memory_governor_t &memoryGovernor() {
+  static memory_governor_t governor;
+  return governor;
 }
 
 /**
- * Make sure that the values in X actually satisfy the equation A * x = b
- *
- * Unfortunately, this check isn't so simple.  Even with double precision
- * floating point, we lose some significant digits, and thus a naive check
- * won't pass.
- */
-void check(matrix_t &A, vector_t &B, vector_t &X) {
-  for (int i = 0; i < A.getSize(); ++i) {
-    // compute the value of B based on X
-    double ans = 0;
-    for (int j = 0; j < A.getSize(); j++)
-      ans += A[i][j] * X[j];
-
-    // we can't just compare ans to B[i].  But if the two are close, then
-    // their ratio will compute to 1 even at double precision
-    double ratio = std::max(abs(ans / B[i]), abs(B[i] / ans));
-    if (ratio <0.999999||ratio>1.00001) {
-      std::cout << "Verification failed for index = " << i << "." << std::endl;
-      std::cout << ans << " != " << B[i] << std::endl;
-      return;
+ * Solve the system made from seed with the matrix in float only, as the
+ * governor does for downgraded solves: Crout with partial pivoting, then
+ * triangular solves in double against the float factors.  Returns the
+ * backward error against the float matrix, or -1 if not asked to check;
+ * throws singular_matrix_t on a zero pivot.
+ */
+double floatSeedSolve(int n, int seed, bool docheck) {
+  basic_matrix_t<float> F(n);
+  vector_t B(n), X(n);
+  initializeFromSeed(seed, F, B, 65536);
+  std::vector<int> piv(n);
+  std::vector<float> ucol(n);
+  for (int j = 0; j < n; ++j)
+    if (croutStep(F, j, true, piv, ucol).pivot.big == 0.0)
+      throw singular_matrix_t();
+  vector_t B2(B);
+  luSolve(F, piv, B2, X);
+  if (!docheck)
+    return -1;
+  vector_t R(n);
+  initializeFromSeed(seed, F, B, 65536);
+  return residual(F, B, X, R);
+}
+
+/**
+ * How many threads a solve of size n can use well.  Each elimination step
+ * is about n^2 work followed by a barrier, so a thread needs a good share
+ * of that to be worth its synchronization: 64K elements per step
+ */
+int threadsFor(int n, int cores) {
+  return std::max(1, std::min(cores, (int)((long)n * n / 65536)));
+}
+
+/**
+ * Run a queue of independent solves with the given solver, sharing the
+ * cores between them.  Each solve runs in its own task_arena, sized by
+ * threadsFor(), so small solves run side by side on a few cores each and
+ * large ones get the whole machine.  Pending solves start largest first,
+ * whenever their cores are free and memoryGovernor() grants their
+ * estimated footprint, so the memory in use never exceeds its budget.
+ * With downgrade, a solve whose double matrix doesn't fit but whose float
+ * matrix does runs in float instead of waiting (or being turned away).
+ */
+void runQueue(std::vector<solve_job_t> &jobs, const solver_t &solver,
+              int cores, bool downgrade, bool docheck) {
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  using std::chrono::high_resolution_clock;
+  auto since = [](high_resolution_clock::time_point t) {
+    return duration_cast<duration<double>>(high_resolution_clock::now() - t)
+        .count();
+  };
+
+  memory_governor_t &governor = memoryGovernor();
+  std::size_t budget = governor.getBudget();
+  std::vector<int> pending;
+  for (std::size_t k = 0; k < jobs.size(); ++k) {
+    if (solveFootprint(jobs[k].n) <= budget)
+      pending.push_back(k);
+    else if (downgrade && solveFootprint(jobs[k].n, true) <= budget) {
+      jobs[k].downgraded = true;
+      pending.push_back(k);
+    } else
+      jobs[k].skipped = true;
+  }
+  std::stable_sort(pending.begin(), pending.end(),
+                   [&](int a, int b) { return jobs[a].n > jobs[b].n; });
+  governor.enqueue(pending.size());
+
+  std::mutex m;
+  std::condition_variable cv;
+  int freeCores = cores;
+  std::vector<std::thread> running;
+  auto start = high_resolution_clock::now();
+  while (!pending.empty()) {
+    // wait until the largest pending solve that fits can start
+    std::unique_lock<std::mutex> lock(m);
+    std::vector<int>::iterator next;
+    cv.wait(lock, [&] {
+      next = std::find_if(pending.begin(), pending.end(), [&](int k) {
+        solve_job_t &job = jobs[k];
+        if (threadsFor(job.n, cores) > freeCores)
+          return false;
+        if (governor.tryReserve(solveFootprint(job.n, job.downgraded)))
+          return true;
+        if (!downgrade || job.downgraded ||
+            !governor.tryReserve(solveFootprint(job.n, true)))
+          return false;
+        job.downgraded = true;
+        return true;
+      });
+      return next != pending.end();
+    });
+    int k = *next;
+    pending.erase(next);
+    governor.enqueue(-1);
+    solve_job_t &job = jobs[k];
+    job.threads = threadsFor(job.n, cores);
+    job.wait = since(start);
+    job.memoryAtStart = governor.inUse();
+    job.queueAtStart = governor.queueDepth();
+    freeCores -= job.threads;
+    lock.unlock();
+
+    running.emplace_back([&, k] {
+      solve_job_t &mine = jobs[k];
+      tbb::task_arena arena(mine.threads);
+      arena.execute([&] {
+        auto t = high_resolution_clock::now();
+        if (mine.downgraded) {
+          try {
+            mine.backwardError = floatSeedSolve(mine.n, mine.seed, docheck);
+          } catch (const singular_matrix_t &) {
+            mine.singular = true;
+          }
+          mine.seconds = since(t);
+          return;
+        }
+        matrix_t A(mine.n);
+        vector_t B(mine.n), X(mine.n);
+        initializeFromSeed(mine.seed, A, B, 65536);
+        t = high_resolution_clock::now();
+        try {
+          solver.solve(A, B, X);
+        } catch (const singular_matrix_t &) {
+          // exceptions can't leave this thread: report it with the rest
+          mine.singular = true;
+        }
+        mine.seconds = since(t);
+        if (docheck && !mine.singular)
+          mine.backwardError =
+              verifyRows(seedRows(mine.seed, mine.n, 65536), mine.n, X,
+                         solver.transposed)
+                  .backwardError;
+      });
+      governor.release(solveFootprint(mine.n, mine.downgraded));
+      std::lock_guard<std::mutex> done(m);
+      freeCores += mine.threads;
+      cv.notify_all();
+    });
+  }
+  for (auto &t : running)
+    t.join();
+  double total = since(start), flops = 0;
+  int solved = 0;
+  for (auto &job : jobs) {
+    std::cout << "  n=" << job.n << " seed=" << job.seed;
+    if (job.skipped) {
+      std::cout << ": skipped, needs more than the memory budget"
+                << std::endl;
+      continue;
     }
+    std::cout << ": " << job.threads << " threads, waited " << job.wait
+              << " s with " << job.memoryAtStart / 1048576.0 << " MiB in use and "
+              << job.queueAtStart << " queued, solved in " << job.seconds
+              << " s";
+    if (job.downgraded)
+      std::cout << " in float";
+    if (job.singular)
+      std::cout << ", but the matrix is singular";
+    if (job.backwardError >= 0)
+      std::cout << ", backward error " << job.backwardError;
+    std::cout << std::endl;
+    flops += solveFlops(job.n);
+    ++solved;
   }
-  std::cout << "Verification succeeded" << std::endl;
+  std::cout << "Throughput: " << solved / total << " solves/s, "
+            << flops / 1e9 / total << " GFLOP/s, peak memory "
+            << governor.peakUse() / 1048576.0 << " MiB of "
+            << budget / 1048576.0 << " MiB" << std::endl;
+  std::cout << "Total execution time: " << total << " seconds" << std::endl;
+}
+
+/**
+ * Parse a queue of solve sizes such as "256x8,1024,2048x2" (size, then an
+ * optional repeat count)
+ */
+std::vector<solve_job_t> parseQueue(const std::string &spec, int seed) {
+  std::vector<solve_job_t> jobs;
+  std::size_t pos = 0;
+  while (pos < spec.size()) {
+    std::size_t end = spec.find(',', pos);
+    if (end == std::string::npos)
+      end = spec.size();
+    std::string item = spec.substr(pos, end - pos);
+    int n = atoi(item.c_str()), count = 1;
+    std::size_t x = item.find('x');
+    if (x != std::string::npos)
+      count = atoi(item.c_str() + x + 1);
+    for (int c = 0; c < count && n > 0; ++c) {
+      solve_job_t job;
+      job.n = n;
+      job.seed = seed + jobs.size();
+      jobs.push_back(job);
+    }
+    pos = end + 1;
+  }
+  return jobs;
 }
 
 /** Print some helpful usage information */
@@ -195,32 +4836,104 @@ void usage() {
          "(default 411)\n");
   printf("    -n <int> : indicate the number of rows in the matrix (default "
          "256)\n");
+  printf("    -l <int> : leading dimension of the matrix (default: padded "
+         "automatically)\n");
   printf("    -g <int> : specify a range for values in the matrix (default "
          "65536)\n");
   printf("    -v       : toggle verbose output (default false)\n");
+  printf("    -P <int> : significant digits of verbose output (default 6)\n");
+  printf("    -b       : toggle binary verbose output; all other output "
+         "goes to stderr,\n               so stdout is just the dumps "
+         "(default false)\n");
+  printf("    -i <str> : load the system from a binary file (as -w or -z "
+         "writes it) instead\n");
+  printf("    -o <str> : write the solution to a binary file\n");
+  printf("    -w <str> : write the system to a binary file\n");
+  printf("    -z <str> : write the system to a compressed binary file, "
+         "which -i reads too\n");
+  printf("    -Z <int> : mantissa bits that -z keeps of each value (default "
+         "52, lossless)\n");
   printf("    -p       : toggle parallel mode (default false)\n");
+  printf("    -t <int> : number of threads in parallel mode (default: all "
+         "cores)\n");
+  printf("    -T <m,s,p,t> : override the micro-tile edge, L1 strip length, "
+         "panel bytes and\n               triangular-solve tile edge (0 "
+         "keeps the probed value)\n");
   printf("    -c       : toggle verifying the result (default true)\n");
+  printf("    -G <num> : monitor pivot growth in gauss, warning when it "
+         "passes this;\n               also where adaptive starts pivoting "
+         "(default 1e4)\n");
+  printf("    -S <int> : take this many implicit time steps of a sparse "
+         "convection-diffusion\n               problem on about n points "
+         "instead, refactoring at each\n");
+  printf("    -D <int> : solve a sequence of this many drifting matrices "
+         "instead, with\n               gauss and by reusing its pivot "
+         "sequence\n");
+  printf("    -a       : toggle also solving A^T * y = b with the same "
+         "factors (default false)\n");
+  printf("    -R <int> : number of timed trials (default 1)\n");
+  printf("    -W <int> : number of untimed warmup trials (default 0)\n");
+  printf("    -s <str> : solver to run, or 'all' to compare them (default "
+         "gauss):\n             ");
+  for (auto &s : solvers())
+    printf(" %s", s.name);
+  printf("\n");
+  printf("    -d <int> : run the differential test of every solver with this "
+         "many seeds per case, then exit\n");
+  printf("    -k       : toggle solving a smooth-kernel integral equation "
+         "with the\n               compressed HODLR solver instead (default "
+         "false)\n");
+  printf("    -m <str> : solve a matrix-free operator of about n unknowns "
+         "instead:\n               poisson, convdiff or convolution\n");
+  printf("    -M <str> : iterative method for -m: bicgstab or cgnr (default "
+         "bicgstab)\n");
+  printf("    -q <str> : run a queue of solves concurrently instead, e.g. "
+         "256x8,1024x2\n               (size, optional repeat count)\n");
+  printf("    -B <int> : memory budget of all solves in MiB (default: half "
+         "of RAM)\n");
+  printf("    -f       : toggle downgrading queued solves to float when "
+         "memory is short\n");
   printf("    -h       : print this message\n");
 }
 
-int main(int argc, char *argv[]) {
+/** Parse the options and run what they ask for */
+int run(int argc, char *argv[]) {
   using std::chrono::duration;
   using std::chrono::duration_cast;
   using std::chrono::high_resolution_clock;
 
   // Config vars that we get via getopt
-tbb::task_scheduler_init init(1);
   int seed = 411; // random seed
   int size = 2048; // # rows in the matrix
+  int stride = 0;  // leading dimension of the matrix, or 0 to pick one
   int range =
       65536; // matrix elements will have values between -range and range
   bool verbose = false;  // should we print some diagnostics?
+  output_t output;       // how to print the matrix and the solution
   bool docheck = true;   // should we verify the output?
+  bool adjoint = false;  // also solve the transposed system?
+  bool kernel = false;   // solve the kernel system with HODLR instead?
+  std::string matfree;   // a matrix-free operator to solve instead, if any
+  std::string method = "bicgstab"; // the iterative method for it
+  std::string queue;     // sizes of a queue of solves to run, if any
+  int drifting = 0;      // length of a sequence of drifting matrices, if any
+  int timesteps = 0;     // time steps of a sparse problem to take, if any
+  std::string input;     // a binary file to load the system from, if any
+  std::string solution;  // a binary file to write the solution to, if any
+  std::string dump;      // a binary file to write the system to, if any
+  std::string archive;   // a compressed file to write the system to, if any
+  int mantissa = 52;     // mantissa bits the compressed file keeps
+  bool downgrade = false; // let the queue downgrade solves to float?
   bool parallel = false; // use parallelism?
+  int threads = tbb::task_scheduler_init::automatic; // threads when parallel
+  int testseeds = 0;     // seeds per case for the differential test
+  int reps = 1;          // timed trials of the solve
+  std::string solvername = "gauss"; // which solver, or "all" of them
+  int warmups = 0;       // untimed trials before the timed ones
 
   // Parse the command line options:
   int o;
-  while ((o = getopt(argc, argv, "r:n:g:hvcp")) != -1) {
+  while ((o = getopt(argc, argv, "r:n:l:g:d:t:T:P:R:W:s:m:M:G:q:B:D:S:i:o:w:z:Z:hvcpabkf")) != -1) {
     switch (o) {
     case 'r':
       seed = atoi(optarg);
@@ -228,6 +4941,9 @@ tbb::task_scheduler_init init(1);
     case 'n':
       size = atoi(optarg);
       break;
+    case 'l':
+      stride = atoi(optarg);
+      break;
     case 'g':
       range = atoi(optarg);
       break;
@@ -237,62 +4953,401 @@ tbb::task_scheduler_init init(1);
     case 'v':
       verbose = !verbose;
       break;
+    case 'P':
+      output.precision = atoi(optarg);
+      break;
+    case 'b':
+      output.binary = !output.binary;
+      break;
     case 'c':
       docheck = !docheck;
       break;
+    case 'a':
+      adjoint = !adjoint;
+      break;
+    case 'k':
+      kernel = !kernel;
+      break;
+    case 'f':
+      downgrade = !downgrade;
+      break;
+    case 'm':
+      matfree = optarg;
+      break;
+    case 'D':
+      drifting = atoi(optarg);
+      break;
+    case 'S':
+      timesteps = atoi(optarg);
+      break;
+    case 'G':
+      growthMonitor().enabled = true;
+      growthMonitor().threshold = atof(optarg);
+      growthMonitor().hook = [](int step, double growth) {
+        std::cout << "Warning: pivot growth " << growth
+                  << " passed the threshold at step " << step << std::endl;
+      };
+      break;
+    case 'M':
+      method = optarg;
+      break;
+    case 'q':
+      queue = optarg;
+      break;
+    case 'B':
+      memoryGovernor().setBudget((std::size_t)atol(optarg) << 20);
+      break;
     case 'p':
       parallel = !parallel;
       break;
+    case 'd':
+      testseeds = atoi(optarg);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'T': {
+      // each field that is given and non-zero replaces the probed value
+      long v[4] = {0, 0, 0, 0};
+      sscanf(optarg, "%ld,%ld,%ld,%ld", &v[0], &v[1], &v[2], &v[3]);
+      tiling_t &t = tiling();
+      t.micro = v[0] > 0 ? v[0] : t.micro;
+      t.strip = v[1] > 0 ? v[1] : t.strip;
+      t.panel = v[2] > 0 ? v[2] : t.panel;
+      t.tile = v[3] > 0 ? v[3] : t.tile;
+      break;
+    }
+    case 'R':
+      reps = std::max(1, atoi(optarg));
+      break;
+    case 'W':
+      warmups = std::max(0, atoi(optarg));
+      break;
+    case 's':
+      solvername = optarg;
+      break;
+    case 'i':
+      input = optarg;
+      break;
+    case 'o':
+      solution = optarg;
+      break;
+    case 'w':
+      dump = optarg;
+      break;
+    case 'z':
+      archive = optarg;
+      break;
+    case 'Z':
+      mantissa = std::max(0, std::min(52, atoi(optarg)));
+      break;
     default:
       usage();
       exit(-1);
     }
   }
 
+  // With -b, stdout carries nothing but the binary dumps
+  if (output.binary)
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+  // Without -p, every TBB construct runs on a single thread
+  tbb::task_scheduler_init init(parallel ? threads : 1);
+
+  // The differential test builds its own systems, so it needs nothing else
+  if (testseeds > 0)
+    return differentialTest(testseeds) == 0 ? 0 : 1;
+
+  // Look up the solvers to run
+  std::vector<solver_t *> chosen;
+  // ("all" means every solver that handles the seeded, uniform, matrices)
+  for (auto &s : solvers())
+    if (solvername == "all" ? s.handles("uniform") : solvername == s.name)
+      chosen.push_back(&s);
+  if (chosen.empty()) {
+    std::cout << "Unknown solver: " << solvername << std::endl;
+    usage();
+    exit(-1);
+  }
+
+  // A system from a file has the size its header says
+  if (!input.empty())
+    size = readBinaryHeader(input.c_str()).rows;
+
   // Print the configuration... this makes results of scripted experiments
   // much easier to parse
-  std::cout << "r,n,g,p = " << seed << ", " << size << ", " << range << ", "
-            << parallel << std::endl;
+  std::cout << "r,n,g,p,t = " << seed << ", " << size << ", " << range
+            << ", " << parallel << ", "
+            << (parallel ? tbb::this_task_arena::max_concurrency() : 1)
+            << std::endl;
+  const tiling_t &tiles = tiling();
+  std::cout << "caches L1,L2,L3/share = " << (tiles.caches.l1 >> 10) << "K, "
+            << (tiles.caches.l2 >> 10) << "K, "
+            << (tiles.caches.l3 >> 10) / tiles.caches.l3share << "K ("
+            << tiles.caches.source << "); tiles m,s,p,t = " << tiles.micro
+            << ", " << tiles.strip << ", " << tiles.panel << ", " << tiles.tile
+            << std::endl;
+
+  // The kernel system is never stored densely, so it has its own path
+  if (kernel) {
+    kernelBenchmark(seed, size, docheck);
+    return 0;
+  }
+
+  // Neither are matrix-free operators
+  if (!matfree.empty()) {
+    matrixFreeBenchmark(matfree, method, seed, size, docheck);
+    return 0;
+  }
+
+  // So are sparse systems
+  if (timesteps > 0) {
+    sparseBenchmark(seed, size, timesteps, docheck);
+    return 0;
+  }
+
+  // A drifting sequence compares pivoting with reusing the pivots
+  if (drifting > 0) {
+    driftBenchmark(seed, size, drifting, 1e-3, docheck);
+    return 0;
+  }
+
+  // A queue of solves makes its own systems, and shares the cores
+  if (!queue.empty()) {
+    std::vector<solve_job_t> jobs = parseQueue(queue, seed);
+    runQueue(jobs, *chosen[0],
+             parallel ? tbb::this_task_arena::max_concurrency() : 1,
+             downgrade, docheck);
+    return 0;
+  }
+
+  // A single solve has to fit in the memory budget too
+  if (!memoryGovernor().tryReserve(solveFootprint(size))) {
+    std::cout << "A system of size " << size << " needs "
+              << solveFootprint(size) / 1048576.0 << " MiB, more than the "
+              << "memory budget of " << memoryGovernor().getBudget() / 1048576.0
+              << " MiB" << std::endl;
+    exit(-1);
+  }
+
+  // Energy is measured around each phase, when the counters exist
+  energy_meter_t meter;
+  auto energystart = meter.sample();
 
   // Create our matrix and vectors, and populate them with default values
-  matrix_t A(size);
+  matrix_t A(size, stride);
   vector_t B(size);
   vector_t X(size);
-  initializeFromSeed(seed, A, B, range);
+  std::cout << "leading dimension = " << A.getStride() << std::endl;
+  auto populate = [&] {
+    if (input.empty())
+      initializeFromSeed(seed, A, B, range);
+    else
+      loadSystem(input.c_str(), A, B);
+  };
+  // the rows of the system again, one at a time, for the verifier
+  row_source_t rows =
+      input.empty() ? seedRows(seed, size, range) : fileRows(input, size);
+  populate();
+  auto energyinit = meter.sample();
+
+  // Save the system as it is, for -i
+  if (!dump.empty()) {
+    auto starttime = high_resolution_clock::now();
+    writeSystem(dump.c_str(), A, B);
+    auto endtime = high_resolution_clock::now();
+    std::cout << "System written in "
+              << duration_cast<duration<double>>(endtime - starttime).count()
+              << " seconds" << std::endl;
+  }
+
+  // Archive the system, compressed
+  if (!archive.empty()) {
+    auto starttime = high_resolution_clock::now();
+    std::size_t bytes = writeCompressed(archive.c_str(), A, B, mantissa);
+    auto endtime = high_resolution_clock::now();
+    double raw = sizeof(binary_header_t) + (double)size * (size + 1) * 8;
+    std::cout << "Compressed system written: " << bytes / 1048576.0
+              << " MiB, " << raw / bytes << "x smaller, in "
+              << duration_cast<duration<double>>(endtime - starttime).count()
+              << " seconds" << std::endl;
+  }
 
   // Print initial matrix
   if (verbose) {
     std::cout << "Matrix (A) | B" << std::endl;
-    print(A, B);
+    print(A, B, output);
   }
 
-  // Calculate solution
-  auto starttime = high_resolution_clock::now();
-  if (parallel)
-    std::cout << "Parallel version not yet implemented" << std::endl;
-  else
-    gauss(A, B, X);
-  auto endtime = high_resolution_clock::now();
+  // Calculate the solution with each chosen solver.  Every trial destroys A
+  // and B, so they are re-created (from the seed, or the file) before each
+  // one but the first.  Warmups prime the caches, the page tables and the thread pool.
+  bool fresh = true;
+  std::vector<double> besttimes;
+  // the interchanges of the last forward solve, if it kept its factors in A
+  std::vector<int> piv;
+  bool factored = false;
+  for (auto *s : chosen) {
+    if (chosen.size() > 1)
+      std::cout << "Solver: " << s->name << std::endl;
+    std::vector<double> times;
+    double solvejoules = 0;
+    growthMonitor().start(0);
+    escalationReport().used = false;
+    butterflyReport().used = false;
+    for (int r = -warmups; r < reps; ++r) {
+      if (!fresh)
+        populate();
+      fresh = false;
+      auto energysolvestart = meter.sample();
+      auto starttime = high_resolution_clock::now();
+      if (adjoint && s->keepFactors)
+        s->keepFactors(A, B, X, piv);
+      else
+        s->solve(A, B, X);
+      auto endtime = high_resolution_clock::now();
+      factored = adjoint && s->keepFactors;
+      if (r < 0)
+        continue;
+      solvejoules += meter.joules(energysolvestart, meter.sample());
+      times.push_back(
+          duration_cast<duration<double>>(endtime - starttime).count());
+    }
+    auto energysolveend = meter.sample();
 
-  // Print result
-  if (verbose) {
-    std::cout << "Result X" << std::endl;
-    for (int i = 0; i < A.getSize(); ++i)
-      std::cout << X[i] << " ";
-    std::cout << std::endl << std::endl;
+    // Only solvers that report growth will have started the monitor
+    if (growthMonitor().enabled && growthMonitor().initial > 0)
+      std::cout << "Pivot growth factor: " << growthMonitor().growth()
+                << std::endl;
+    if (escalationReport().used) {
+      const escalation_t &e = escalationReport();
+      std::cout << "Mixed-precision solve: ";
+      if (e.pivotFrom < 0)
+        std::cout << "no pivoting";
+      else
+        std::cout << "pivoting from column " << e.pivotFrom;
+      if (e.doublePrecision)
+        std::cout << ", refactored in double" << std::endl;
+      else
+        std::cout << ", " << e.storage << " factors, " << e.refinements
+                  << " refinement steps, backward error " << e.backwardError
+                  << std::endl;
+    }
+    if (butterflyReport().used) {
+      const butterfly_report_t &r = butterflyReport();
+      if (r.failure)
+        std::cout << "Butterfly solve: failed without pivoting ("
+                  << r.failure << "), solved with pivoting" << std::endl;
+      else
+        std::cout << "Butterfly solve: no pivoting, " << r.refinements
+                  << " refinement steps, backward error " << r.backwardError
+                  << std::endl;
+    }
+
+    // Print result
+    if (verbose) {
+      std::cout << "Result X" << std::endl;
+      printSolution(X, output);
+    }
+
+    // Check the solution?
+    if (docheck) {
+      // Pseudorandom number generators are nice... We can re-create each
+      // row of A and B from the same seed as before (or reread it from the
+      // file) just when it is needed, and leave the factors in A alone
+      check(rows, size, X, 64.0 * size * s->eps, s->transposed);
+    }
+    auto energycheck = meter.sample();
+
+    // Print the execution time, with statistics when there were many trials
+    timing_stats_t stats = summarize(times);
+    besttimes.push_back(stats.min);
+    if (reps == 1) {
+      std::cout << "Total execution time: " << times[0] << " seconds"
+                << std::endl;
+    } else {
+      std::cout << "Execution time of " << reps
+                << " trials (min, median, mean, stddev): " << stats.min
+                << ", " << stats.median << ", " << stats.mean << ", "
+                << stats.stddev << " seconds" << std::endl;
+      std::cout << "95% confidence interval of the mean: ["
+                << stats.mean - stats.ci95 << ", " << stats.mean + stats.ci95
+                << "] seconds" << std::endl;
+    }
+
+    // Print the energy of each phase, and the efficiency of the solve
+    if (meter.available()) {
+      solvejoules /= reps;
+      std::cout << "Energy (initialize, solve, check): "
+                << meter.joules(energystart, energyinit) << ", "
+                << solvejoules << ", "
+                << meter.joules(energysolveend, energycheck) << " joules"
+                << std::endl;
+      std::cout << "Solve efficiency: "
+                << solveFlops(size) / 1e9 / solvejoules << " GFLOP/J"
+                << std::endl;
+    } else {
+      std::cout << "Energy: RAPL counters unavailable" << std::endl;
+    }
   }
 
-  // Check the solution?
-  if (docheck) {
-    // Pseudorandom number generators are nice... We can re-create A and
-    // B by re-initializing them from the same seed as before
-    initializeFromSeed(seed, A, B, range);
-    check(A, B, X);
+  // Save the solution (of the last solver) for later runs
+  if (!solution.empty()) {
+    auto starttime = high_resolution_clock::now();
+    writeSolution(solution.c_str(), X);
+    auto endtime = high_resolution_clock::now();
+    std::cout << "Solution written in "
+              << duration_cast<duration<double>>(endtime - starttime).count()
+              << " seconds (" << (asyncIO().usingRing() ? "io_uring" : "threads")
+              << ")" << std::endl;
   }
 
-  // Print the execution time
-  duration<double> time_span =
-      duration_cast<duration<double>>(endtime - starttime);
-  std::cout << "Total execution time: " << time_span.count() << " seconds"
-            << std::endl;
-}
\ No newline at end of file
+  // Solve the adjoint system A^T * y = b with the factors of A, as a
+  // sensitivity analysis would after the forward solve
+  if (adjoint) {
+    if (factored) {
+      // the forward solve overwrote b, so only b is made again
+      rows([&](std::size_t i, std::size_t j, const double *v,
+               std::size_t count) {
+        for (std::size_t k = 0; k < count; ++k)
+          if (j + k == B.getSize())
+            B[i] = v[k];
+      });
+    } else {
+      // the last solver left no factors (see solver_t::keepFactors), so
+      // A is factored once more
+      if (!fresh)
+        populate();
+      gaussFactor(A, piv);
+    }
+    vector_t Y(size);
+    auto starttime = high_resolution_clock::now();
+    luSolveTranspose(A, piv, B, Y);
+    auto endtime = high_resolution_clock::now();
+    if (docheck)
+      check(rows, size, Y, 64.0 * size * DBL_EPSILON / 2, true);
+    std::cout << "Transpose solve time: "
+              << duration_cast<duration<double>>(endtime - starttime).count()
+              << " seconds" << std::endl;
+  }
+
+  // Put the solvers side by side, relative to the first one
+  if (chosen.size() > 1) {
+    std::cout << "Solver comparison (best seconds, GFLOP/s, speedup):"
+              << std::endl;
+    for (std::size_t k = 0; k < chosen.size(); ++k)
+      std::cout << "  " << chosen[k]->name << ": " << besttimes[k] << ", "
+                << solveFlops(size) / 1e9 / besttimes[k] << ", "
+                << besttimes[0] / besttimes[k] << std::endl;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    return run(argc, argv);
+  } catch (const singular_matrix_t &e) {
+    std::cout << e.what() << std::endl;
+    exit(-1);
+  }
+}